@@ -0,0 +1,55 @@
+#include "alloc_stats.hpp"
+
+#ifdef NGC_ALLOC_STATS
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> allocations = 0;
+std::atomic<uint64_t> bytes = 0;
+std::atomic<uint64_t> live_bytes = 0;
+std::atomic<uint64_t> peak_bytes = 0;
+
+void* counted_alloc(std::size_t size) {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    uint64_t usable = malloc_usable_size(ptr);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(usable, std::memory_order_relaxed);
+    uint64_t live = live_bytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+    uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        ;
+    return ptr;
+}
+
+void counted_free(void* ptr) {
+    if (ptr == nullptr)
+        return;
+    live_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    std::free(ptr);
+}
+}  // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { counted_free(ptr); }
+
+bool utils::allocation_counting() { return true; }
+
+utils::alloc_counters utils::allocation_counters() {
+    return {allocations.load(), bytes.load(), peak_bytes.load()};
+}
+#else
+bool utils::allocation_counting() { return false; }
+
+utils::alloc_counters utils::allocation_counters() { return {}; }
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace utils {
+struct alloc_counters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t peak_bytes = 0;
+};
+
+// true when built with ALLOC_STATS=1, which replaces the global operator new
+// and delete with counting versions
+bool allocation_counting();
+// heap traffic of the whole process so far, all zero unless counting
+alloc_counters allocation_counters();
+}  // namespace utils
@@ -0,0 +1,196 @@
+#include "async_reader.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+/* the submission and completion rings of an io_uring, mapped from the
+kernel. There is no liburing here, the three system calls are enough for
+plain reads. One thread produces submissions and one consumes completions,
+the ring indices are shared with the kernel through acquire and release. */
+struct wc::async_reader::uring {
+    int fd = -1;
+    void* sq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    void* cq_ring = MAP_FAILED;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    static unsigned load_acquire(unsigned* p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void store_release(unsigned* p, unsigned value) {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                       nullptr, 0);
+    }
+
+    // false if the kernel refuses, in which case nothing is left open
+    bool setup(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return false;
+        cq_ring = single ? sq_ring
+                         : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            return false;
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size,
+                                               PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, fd,
+                                               IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return false;
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    ~uring() {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    void submit(const request& r) {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = r.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(r.data);
+        sqe.len = r.length;
+        sqe.off = r.offset;
+        sqe.user_data = r.tag;
+        sq_array[index] = index;
+        store_release(sq_tail, tail + 1);
+        // the entry is in the ring already, so only a second try can take
+        // it back out; anything but a transient failure is a broken ring
+        while (enter(1, 0, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                std::cerr << " * io_uring_enter: " << std::strerror(errno) << std::endl;
+                std::abort();
+            }
+        }
+    }
+
+    void wait(uint64_t& tag, int64_t& result) {
+        for (;;) {
+            unsigned head = *cq_head;
+            if (head != load_acquire(cq_tail)) {
+                const io_uring_cqe& cqe = cqes[head & cq_mask];
+                tag = cqe.user_data;
+                result = cqe.res;
+                store_release(cq_head, head + 1);
+                return;
+            }
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+};
+
+wc::async_reader::async_reader(uint32_t depth, bool use_uring) {
+    if (use_uring) {
+        ring = std::make_unique<uring>();
+        if (!ring->setup(depth))
+            ring.reset();
+    }
+    if (ring)
+        return;
+    for (uint32_t i = 0; i != depth; i++) threads.push_back(std::thread(&async_reader::serve, this));
+}
+
+wc::async_reader::~async_reader() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        requested.notify_all();
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+void wc::async_reader::submit(const request& r) {
+    if (ring) {
+        // completions may resubmit what is left of a short read
+        std::lock_guard<std::mutex> lock(submit_mtx);
+        ring->submit(r);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    requests.push_back(r);
+    requested.notify_one();
+}
+
+void wc::async_reader::wait(uint64_t& tag, int64_t& result) {
+    if (ring) {
+        ring->wait(tag, result);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    completed.wait(lock, [this] { return !completions.empty(); });
+    tag = completions.front().tag;
+    result = completions.front().result;
+    completions.pop_front();
+}
+
+void wc::async_reader::serve() {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+        requested.wait(lock, [this] { return stopping || !requests.empty(); });
+        if (requests.empty())
+            return;
+        request r = requests.front();
+        requests.pop_front();
+        lock.unlock();
+        ssize_t got = pread(r.fd, r.data, r.length, r.offset);
+        int64_t result = got < 0 ? -errno : got;
+        lock.lock();
+        completions.push_back({r.tag, result});
+        completed.notify_one();
+    }
+}
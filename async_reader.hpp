@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wc {
+/* reads issued by one thread and completed in the background, through an
+io_uring or, where the kernel does not allow one (or it is not wanted), a
+pool of threads calling pread. Completions come back in any order, with the
+tag they were submitted with. Submitting and waiting may happen on different
+threads. */
+class async_reader {
+   public:
+    struct request {
+        int fd;
+        char* data;
+        size_t length;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    // at most `depth` reads are ever in flight
+    async_reader(uint32_t depth, bool use_uring);
+    ~async_reader();
+    async_reader(const async_reader&) = delete;
+    async_reader& operator=(const async_reader&) = delete;
+
+    bool uses_uring() const { return ring != nullptr; }
+    void submit(const request& r);
+    // wait for a read to finish; `result` is the number of bytes read, which
+    // may be short, or -errno
+    void wait(uint64_t& tag, int64_t& result);
+
+   private:
+    struct uring;
+    std::unique_ptr<uring> ring;
+    std::mutex submit_mtx;
+
+    // the thread pool, used when there is no ring
+    struct completion {
+        uint64_t tag;
+        int64_t result;
+    };
+    std::mutex mtx;
+    std::condition_variable requested;
+    std::condition_variable completed;
+    std::deque<request> requests;
+    std::deque<completion> completions;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    void serve();
+};
+}  // namespace wc
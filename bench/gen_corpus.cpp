@@ -0,0 +1,95 @@
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../utils.hpp"
+#include "zipf_text.hpp"
+
+namespace fs = std::filesystem;
+
+/* writes a synthetic corpus of .txt files for benchmarking, Zipf-distributed
+words in sentences of some mean length, with file sizes that follow a power
+law so that a few files can hold most of the bytes */
+struct corpus_options {
+    uint32_t files = 64;
+    uint64_t total_size = 64 << 20;
+    // file i gets a share of the bytes proportional to 1 / (i + 1)^size_skew
+    double size_skew = 0;
+    uint32_t vocabulary = 50000;
+    // word of rank r is drawn with probability proportional to 1 / r^zipf
+    double zipf = 1.0;
+    uint32_t sentence_words = 12;
+    uint64_t seed = 1;
+};
+
+static int usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options] <dir>\n"
+              << "Options:\n"
+              << "  --files=<n>       number of files (64)\n"
+              << "  --size=<size>     total bytes, e.g. 256M (64M)\n"
+              << "  --skew=<s>        file sizes fall off as 1/i^s (0, all equal)\n"
+              << "  --vocab=<n>       distinct words (50000)\n"
+              << "  --zipf=<s>        word frequencies fall off as 1/rank^s (1.0)\n"
+              << "  --sentence=<n>    mean words per sentence (12)\n"
+              << "  --seed=<n>        random seed (1)" << std::endl;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    corpus_options opts;
+    fs::path dir;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+            if (arg.substr(0, 8) == "--files=")
+                opts.files = std::stoul(arg.substr(8));
+            else if (arg.substr(0, 7) == "--size=")
+                opts.total_size = utils::parse_size(arg.substr(7));
+            else if (arg.substr(0, 7) == "--skew=")
+                opts.size_skew = std::stod(arg.substr(7));
+            else if (arg.substr(0, 8) == "--vocab=")
+                opts.vocabulary = std::stoul(arg.substr(8));
+            else if (arg.substr(0, 7) == "--zipf=")
+                opts.zipf = std::stod(arg.substr(7));
+            else if (arg.substr(0, 11) == "--sentence=")
+                opts.sentence_words = std::stoul(arg.substr(11));
+            else if (arg.substr(0, 7) == "--seed=")
+                opts.seed = std::stoull(arg.substr(7));
+            else if (arg[0] != '-' && dir.empty())
+                dir = arg;
+            else
+                return usage(argv[0]);
+        }
+    } catch (const std::exception&) {
+        return usage(argv[0]);
+    }
+    if (dir.empty() || opts.files == 0 || opts.vocabulary == 0 || opts.sentence_words == 0)
+        return usage(argv[0]);
+
+    zipf_text text_source(opts.vocabulary, opts.zipf, opts.sentence_words, opts.seed);
+
+    std::vector<double> shares(opts.files);
+    for (uint32_t i = 0; i != opts.files; i++) shares[i] = 1 / std::pow(i + 1, opts.size_skew);
+    double total_share = 0;
+    for (double share : shares) total_share += share;
+
+    fs::create_directories(dir);
+    std::string text;
+    for (uint32_t i = 0; i != opts.files; i++) {
+        uint64_t size = opts.total_size * (shares[i] / total_share);
+        text.clear();
+        text_source.append(text, size);
+        fs::path file = dir / ("doc-" + std::to_string(i) + ".txt");
+        std::ofstream out(file, std::ios::binary);
+        out.write(text.data(), text.size());
+        if (!out) {
+            std::cerr << " * cannot write " << file.string() << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../counter_table.hpp"
+#include "../emit.hpp"
+#include "../n-gram_window.hpp"
+#include "../tokenizer.hpp"
+#include "../top_k.hpp"
+#include "../vocabulary.hpp"
+#include "zipf_text.hpp"
+
+/* microbenchmarks of the steps of a count, each on the same few megabytes of
+Zipf text: tokenizing it, building the keys of its n-grams, counting them
+into tables, merging tables and selecting the top k */
+
+namespace {
+const std::string& sample_text() {
+    static const std::string text = [] {
+        std::string out;
+        zipf_text(50000, 1.0, 12, 1).append(out, 4 << 20);
+        return out;
+    }();
+    return text;
+}
+
+// the text keys of every n-gram of one order in a text, with their hashes
+struct sample_keys {
+    std::vector<std::string> keys;
+    std::vector<uint64_t> hashes;
+};
+
+const sample_keys& keys_of_order(uint32_t n) {
+    static std::vector<sample_keys> cache(4);
+    sample_keys& sample = cache[n - 1];
+    if (!sample.keys.empty())
+        return sample;
+    wc::ngram_window window(n);
+    wc::tokenizer tok(sample_text());
+    std::string_view word;
+    for (wc::tokenizer::token_type type; (type = tok.next(word)) != wc::tokenizer::done;) {
+        if (type == wc::tokenizer::sentence_end) {
+            window.reset();
+        } else if (window.push(word) == n) {
+            sample.keys.emplace_back(window.key(n));
+            sample.hashes.push_back(wc::hash_key(sample.keys.back()));
+        }
+    }
+    return sample;
+}
+
+wc::counter_table table_of(const sample_keys& sample, size_t begin, size_t end) {
+    wc::counter_table table;
+    for (size_t i = begin; i != end; i++) table.add(sample.keys[i], sample.hashes[i]);
+    return table;
+}
+
+void set_text_bytes(benchmark::State& state, const std::string& text) {
+    state.SetBytesProcessed(int64_t(state.iterations()) * text.size());
+}
+}  // namespace
+
+static void BM_tokenize(benchmark::State& state) {
+    const std::string& text = sample_text();
+    size_t words = 0;
+    for (auto _ : state) {
+        wc::tokenizer tok(text);
+        std::string_view word;
+        for (wc::tokenizer::token_type type; (type = tok.next(word)) != wc::tokenizer::done;)
+            words += type == wc::tokenizer::word;
+    }
+    benchmark::DoNotOptimize(words);
+    set_text_bytes(state, text);
+}
+BENCHMARK(BM_tokenize);
+
+// every order from 1 to n as hashed text keys
+static void BM_emit_text(benchmark::State& state) {
+    const std::string& text = sample_text();
+    uint32_t n = state.range(0);
+    uint64_t sum = 0;
+    for (auto _ : state) {
+        wc::ngram_window window(1, n);
+        wc::tokenizer tok(text);
+        std::string_view word;
+        for (wc::tokenizer::token_type type; (type = tok.next(word)) != wc::tokenizer::done;) {
+            if (type == wc::tokenizer::sentence_end) {
+                window.reset();
+                continue;
+            }
+            for (uint32_t k = window.push(word); k != 0; k--) sum += wc::hash_key(window.key(k));
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    set_text_bytes(state, text);
+}
+BENCHMARK(BM_emit_text)->Arg(1)->Arg(3);
+
+// the same as packed word ids, through a word cache
+static void BM_emit_ids(benchmark::State& state) {
+    const std::string& text = sample_text();
+    uint32_t n = state.range(0);
+    wc::vocabulary vocab;
+    wc::word_cache words(vocab);
+    std::string folded;
+    uint64_t sum = 0;
+    for (auto _ : state) {
+        wc::id_window window(1, n);
+        wc::tokenizer tok(text);
+        std::string_view word;
+        for (wc::tokenizer::token_type type; (type = tok.next(word)) != wc::tokenizer::done;) {
+            if (type == wc::tokenizer::sentence_end) {
+                window.reset();
+                continue;
+            }
+            folded.clear();
+            wc::append_folded(folded, word);
+            for (uint32_t k = window.push(words.id(folded)); k != 0; k--)
+                sum += wc::hash_ids(window.key(k));
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    set_text_bytes(state, text);
+}
+BENCHMARK(BM_emit_ids)->Arg(1)->Arg(3);
+
+// the whole id kernel, the generic window against the one fixed at compile
+// time, into a sink that only sums the hashes
+struct hash_sum {
+    uint64_t sum = 0;
+    void add(std::string_view, uint64_t hash, uint32_t) { sum += hash; }
+};
+
+static void BM_kernel_generic(benchmark::State& state) {
+    const std::string& text = sample_text();
+    wc::vocabulary vocab;
+    wc::word_cache words(vocab);
+    wc::thread_stats stats;
+    hash_sum sink;
+    for (auto _ : state) wc::emit_ids_generic(text, 1, state.range(0), sink, words, stats);
+    benchmark::DoNotOptimize(sink.sum);
+    set_text_bytes(state, text);
+}
+BENCHMARK(BM_kernel_generic)->Arg(1)->Arg(2)->Arg(3);
+
+static void BM_kernel_fixed(benchmark::State& state) {
+    const std::string& text = sample_text();
+    wc::vocabulary vocab;
+    wc::word_cache words(vocab);
+    wc::thread_stats stats;
+    hash_sum sink;
+    for (auto _ : state) wc::emit_ids(text, 1, state.range(0), sink, words, stats);
+    benchmark::DoNotOptimize(sink.sum);
+    set_text_bytes(state, text);
+}
+BENCHMARK(BM_kernel_fixed)->Arg(1)->Arg(2)->Arg(3);
+
+static void BM_table_insert(benchmark::State& state) {
+    const sample_keys& sample = keys_of_order(state.range(0));
+    for (auto _ : state) {
+        wc::counter_table table = table_of(sample, 0, sample.keys.size());
+        benchmark::DoNotOptimize(table.size());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * sample.keys.size());
+}
+BENCHMARK(BM_table_insert)->Arg(1)->Arg(2)->Arg(3);
+
+// two tables of half the n-grams each, as a reducer merges mapper pieces
+static void BM_table_merge(benchmark::State& state) {
+    const sample_keys& sample = keys_of_order(state.range(0));
+    size_t half = sample.keys.size() / 2;
+    size_t entries = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        wc::counter_table a = table_of(sample, 0, half);
+        wc::counter_table b = table_of(sample, half, sample.keys.size());
+        entries += b.size();
+        state.ResumeTiming();
+        a.merge(std::move(b));
+        benchmark::DoNotOptimize(a.size());
+    }
+    state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_table_merge)->Arg(1)->Arg(3);
+
+static void BM_select_top(benchmark::State& state) {
+    const sample_keys& sample = keys_of_order(3);
+    wc::counter_table table = table_of(sample, 0, sample.keys.size());
+    for (auto _ : state) {
+        std::vector<wc::ranked_entry> top = wc::select_top(
+            table, state.range(0), [](const wc::counter_table::entry&) { return true; },
+            [](const wc::counter_table::entry& e, std::string& text) { text = e.key(); });
+        benchmark::DoNotOptimize(top.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * table.size());
+}
+BENCHMARK(BM_select_top)->Arg(5)->Arg(1000)->Arg(100000);
+
+BENCHMARK_MAIN();
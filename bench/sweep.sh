@@ -0,0 +1,60 @@
+#!/bin/sh
+# end-to-end benchmark: generates a synthetic corpus, counts it with every
+# combination of thread counts and orders, and reports the throughput and the
+# scaling efficiency (speedup over one thread, divided by the threads)
+#
+# usage: bench/sweep.sh [gen_corpus options]
+# environment:
+#   THREADS  thread counts to sweep (default: 1 2 4 ... up to the cores)
+#   ORDERS   values of -n to sweep (default: 1 2 3)
+#   REPEAT   runs per point, the fastest counts (default: 3)
+#   CORPUS   where the corpus goes (default: $TMPDIR/ngc-bench), kept between runs
+#            with the same options
+#   NGC_ARGS extra options for ngc++, e.g. --io=mmap
+set -e
+here=$(dirname "$0")
+ngc="$here/../ngc++"
+gen="$here/gen_corpus"
+corpus=${CORPUS:-${TMPDIR:-/tmp}/ngc-bench}
+orders=${ORDERS:-"1 2 3"}
+repeat=${REPEAT:-3}
+if [ -z "$THREADS" ]; then
+    cores=$(nproc)
+    THREADS=1
+    t=2
+    while [ $t -le "$cores" ]; do
+        THREADS="$THREADS $t"
+        t=$((t * 2))
+    done
+fi
+
+if [ "$(cat "$corpus/.options" 2>/dev/null)" != "$*" ]; then
+    rm -rf "$corpus"
+    "$gen" "$@" "$corpus"
+    echo "$*" > "$corpus/.options"
+fi
+bytes=$(cat "$corpus"/*.txt | wc -c)
+echo "corpus: $(ls "$corpus"/*.txt | wc -l) files, $((bytes / 1048576)) MB ($*)"
+
+now() { date +%s.%N; }
+calc() { awk "BEGIN { print $1 }"; }
+printf "%8s %8s %10s %10s %10s\n" n threads seconds MB/s efficiency
+for n in $orders; do
+    base=""
+    for t in $THREADS; do
+        best=""
+        i=0
+        while [ $i -lt "$repeat" ]; do
+            start=$(now)
+            "$ngc" -n=$n -t=$t $NGC_ARGS "$corpus" > /dev/null
+            took=$(calc "$(now) - $start")
+            if [ -z "$best" ] || [ "$(calc "$took < $best")" = 1 ]; then
+                best=$took
+            fi
+            i=$((i + 1))
+        done
+        [ -n "$base" ] || base=$(calc "$best * $t")
+        printf "%8s %8s %10.3f %10.1f %9.0f%%\n" $n $t $best \
+            "$(calc "$bytes / 1048576 / $best")" "$(calc "100 * $base / $best / $t")"
+    done
+done
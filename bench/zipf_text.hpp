@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/* synthetic text for benchmarks: words are drawn from a vocabulary of random
+lowercase words of 2 to 10 letters, the word of rank r with probability
+proportional to 1 / r^zipf, and sentences have a geometric number of words
+around a mean, each ending in a sentence break. The same seed gives the
+same text. */
+class zipf_text {
+    std::mt19937_64 rng;
+    std::vector<std::string> words;
+    std::discrete_distribution<uint32_t> pick_word;
+    std::geometric_distribution<uint32_t> sentence_length;
+
+   public:
+    zipf_text(uint32_t vocabulary, double zipf, uint32_t sentence_words, uint64_t seed)
+        : rng(seed), sentence_length(1.0 / std::max<uint32_t>(sentence_words, 1)) {
+        std::uniform_int_distribution<int> letter('a', 'z'), length(2, 10);
+        while (words.size() < vocabulary) {
+            std::string word;
+            for (int i = length(rng); i != 0; i--) word.push_back(letter(rng));
+            words.push_back(word);
+            if (words.size() == vocabulary) {
+                std::sort(words.begin(), words.end());
+                words.erase(std::unique(words.begin(), words.end()), words.end());
+            }
+        }
+        std::shuffle(words.begin(), words.end(), rng);
+        std::vector<double> weights(words.size());
+        for (size_t r = 0; r != words.size(); r++) weights[r] = 1 / std::pow(r + 1, zipf);
+        pick_word = std::discrete_distribution<uint32_t>(weights.begin(), weights.end());
+    }
+
+    // append whole sentences to `out` until it holds at least `size` bytes
+    void append(std::string& out, size_t size) {
+        static const char breaks[] = {'.', '.', '.', '!', '?'};
+        while (out.size() < size) {
+            for (uint32_t w = sentence_length(rng) + 1; w != 0; w--) {
+                out.append(words[pick_word(rng)]);
+                out.push_back(w == 1 ? breaks[rng() % sizeof(breaks)] : ' ');
+            }
+            out.push_back(rng() % 8 == 0 ? '\n' : ' ');
+        }
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wc {
+// byte classes of the text normalization: ascii letters form words, digits
+// and punctuation end a sentence, every other byte separates two words
+enum class char_class : uint8_t { separator, letter, sentence_break };
+
+namespace detail {
+constexpr std::array<char_class, 256> make_class_table() {
+    std::array<char_class, 256> table{};
+    for (int c = 0; c != 256; c++) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            table[c] = char_class::letter;
+        else if (c >= '!' && c <= '~')  // digits and ascii punctuation
+            table[c] = char_class::sentence_break;
+        else
+            table[c] = char_class::separator;
+    }
+    return table;
+}
+
+constexpr std::array<char, 256> make_fold_table() {
+    std::array<char, 256> table{};
+    for (int c = 0; c != 256; c++)
+        table[c] = (char) (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    return table;
+}
+
+inline constexpr std::array<char_class, 256> class_table = make_class_table();
+inline constexpr std::array<char, 256> fold_table = make_fold_table();
+}  // namespace detail
+
+inline char_class classify(char c) {
+    return detail::class_table[(unsigned char) c];
+}
+
+inline char fold(char c) { return detail::fold_table[(unsigned char) c]; }
+
+// folds a word from its first byte above 0x7f on, codepoint by codepoint
+void append_folded_utf8(std::string& out, std::string_view word);
+
+// words of ascii mode never hold a byte above 0x7f, only utf8 mode goes on
+// past the first one
+inline void append_folded(std::string& out, std::string_view word) {
+    size_t size = out.size();
+    out.resize(size + word.size());
+    for (size_t i = 0; i != word.size(); i++) {
+        if ((unsigned char) word[i] >= 0x80) {
+            out.resize(size + i);
+            append_folded_utf8(out, word.substr(i));
+            return;
+        }
+        out[size + i] = fold(word[i]);
+    }
+}
+
+/* classification of 64 bytes of text at once: bit i of `letters` is set when
+byte i is an ascii letter, bit i of `breaks` when it ends a sentence (a digit
+or ascii punctuation). Everything else separates words. */
+struct char_masks {
+    uint64_t letters;
+    uint64_t breaks;
+};
+
+namespace detail {
+#if defined(__AVX2__)
+inline uint64_t letter_bits(__m256i v) {
+    // (c | 0x20) - 'a' < 26, done as a signed compare after biasing by 128
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i biased = _mm256_add_epi8(lower, _mm256_set1_epi8((char) (128 - 'a')));
+    return (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + 26)), biased));
+}
+inline uint64_t printable_bits(__m256i v) {
+    // '!' <= c <= '~'
+    __m256i biased = _mm256_add_epi8(v, _mm256_set1_epi8((char) (128 - '!')));
+    return (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + '~' - '!' + 1)), biased));
+}
+inline char_masks classify_full_block(const char* p) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    uint64_t letters = letter_bits(lo) | letter_bits(hi) << 32;
+    uint64_t printable = printable_bits(lo) | printable_bits(hi) << 32;
+    return {letters, printable & ~letters};
+}
+#elif defined(__SSE2__)
+inline uint64_t letter_bits(__m128i v) {
+    // (c | 0x20) - 'a' < 26, done as a signed compare after biasing by 128
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i biased = _mm_add_epi8(lower, _mm_set1_epi8((char) (128 - 'a')));
+    return (uint32_t) _mm_movemask_epi8(
+        _mm_cmplt_epi8(biased, _mm_set1_epi8((char) (-128 + 26))));
+}
+inline uint64_t printable_bits(__m128i v) {
+    // '!' <= c <= '~'
+    __m128i biased = _mm_add_epi8(v, _mm_set1_epi8((char) (128 - '!')));
+    return (uint32_t) _mm_movemask_epi8(
+        _mm_cmplt_epi8(biased, _mm_set1_epi8((char) (-128 + '~' - '!' + 1))));
+}
+inline char_masks classify_full_block(const char* p) {
+    uint64_t letters = 0, printable = 0;
+    for (int i = 0; i != 4; i++) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        letters |= letter_bits(v) << (16 * i);
+        printable |= printable_bits(v) << (16 * i);
+    }
+    return {letters, printable & ~letters};
+}
+#elif defined(__ARM_NEON)
+inline uint64_t to_bits(uint8x16_t eq) {
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                        1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t masked = vandq_u8(eq, vld1q_u8(weights));
+    return vaddv_u8(vget_low_u8(masked)) |
+           (uint64_t) vaddv_u8(vget_high_u8(masked)) << 8;
+}
+inline char_masks classify_full_block(const char* p) {
+    uint64_t letters = 0, printable = 0;
+    for (int i = 0; i != 4; i++) {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p + 16 * i));
+        uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+        uint8x16_t letter = vcltq_u8(vsubq_u8(lower, vdupq_n_u8('a')), vdupq_n_u8(26));
+        uint8x16_t print =
+            vcltq_u8(vsubq_u8(v, vdupq_n_u8('!')), vdupq_n_u8('~' - '!' + 1));
+        letters |= to_bits(letter) << (16 * i);
+        printable |= to_bits(print) << (16 * i);
+    }
+    return {letters, printable & ~letters};
+}
+#else
+inline char_masks classify_full_block(const char* p) {
+    uint64_t letters = 0, breaks = 0;
+    for (int i = 0; i != 64; i++) {
+        char_class cls = classify(p[i]);
+        letters |= (uint64_t) (cls == char_class::letter) << i;
+        breaks |= (uint64_t) (cls == char_class::sentence_break) << i;
+    }
+    return {letters, breaks};
+}
+#endif
+}  // namespace detail
+
+// classify the `len` <= 64 bytes at `p`; bits past `len` are left clear
+inline char_masks classify_block(const char* p, size_t len) {
+    if (len == 64)
+        return detail::classify_full_block(p);
+    char padded[64] = {};
+    std::memcpy(padded, p, len);
+    return detail::classify_full_block(padded);
+}
+}  // namespace wc
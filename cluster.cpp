@@ -0,0 +1,349 @@
+#include "cluster.hpp"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace {
+// entries are batched up to this many bytes before they are compressed
+constexpr size_t batch_bytes = 1 << 20;
+
+[[noreturn]] void fail(const std::string& what) {
+    std::cerr << " * cluster: " << what << std::endl;
+    std::exit(1);
+}
+
+void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+bool get_varint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+void put_string(std::string& out, std::string_view s) {
+    put_varint(out, s.size());
+    out.append(s);
+}
+
+bool get_string(const char*& p, const char* end, std::string_view& s) {
+    uint64_t length;
+    if (!get_varint(p, end, length) || length > uint64_t(end - p))
+        return false;
+    s = std::string_view(p, length);
+    p += length;
+    return true;
+}
+
+// host and port of "host:port"
+void split_address(const std::string& address, std::string& host, std::string& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        fail("no port in " + address);
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+}
+
+int listen_on(const std::string& port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* found;
+    // a dual-stack socket where there is IPv6, IPv4 otherwise
+    if (getaddrinfo(nullptr, port.c_str(), &hints, &found) != 0) {
+        hints.ai_family = AF_INET;
+        if (getaddrinfo(nullptr, port.c_str(), &hints, &found) != 0)
+            fail("cannot listen on port " + port);
+    }
+    int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    int on = 1;
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (fd < 0 || bind(fd, found->ai_addr, found->ai_addrlen) != 0 || listen(fd, 64) != 0)
+        fail("cannot listen on port " + port);
+    freeaddrinfo(found);
+    return fd;
+}
+
+// nodes start in any order, so a node that is not up yet is retried a while
+int connect_to(const std::string& address) {
+    std::string host, port;
+    split_address(address, host, port);
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    for (;;) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) == 0) {
+            for (addrinfo* a = found; a != nullptr; a = a->ai_next) {
+                int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+                if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+                    freeaddrinfo(found);
+                    return fd;
+                }
+                if (fd >= 0)
+                    close(fd);
+            }
+            freeaddrinfo(found);
+        }
+        if (std::chrono::steady_clock::now() > give_up)
+            fail("cannot connect to " + address);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+std::string hello_message(uint32_t rank, const std::string& settings) {
+    std::string payload;
+    put_varint(payload, rank);
+    put_string(payload, settings);
+    return payload;
+}
+
+// the rank in a hello from a node with the same settings
+uint32_t read_hello(wc::link& from, const std::string& settings) {
+    wc::link::message_type type;
+    std::string payload;
+    if (!from.receive(type, payload) || type != wc::link::hello)
+        fail("a node did not say hello");
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    uint64_t rank;
+    std::string_view theirs;
+    if (!get_varint(p, end, rank) || !get_string(p, end, theirs))
+        fail("a node did not say hello");
+    if (theirs != settings)
+        fail("node " + std::to_string(rank) + " runs with other settings: " +
+             std::string(theirs));
+    return rank;
+}
+}  // namespace
+
+wc::link::~link() { close(fd); }
+
+void wc::link::send(message_type type, std::string_view payload) {
+    char header[9];
+    uint64_t length = payload.size();
+    header[0] = (char) type;
+    std::memcpy(header + 1, &length, sizeof(length));
+    std::lock_guard<std::mutex> lock(send_mtx);
+    for (std::string_view part : {std::string_view(header, sizeof(header)), payload}) {
+        while (!part.empty()) {
+            ssize_t sent = ::send(fd, part.data(), part.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                fail("lost a node");
+            part.remove_prefix(sent);
+        }
+    }
+}
+
+bool wc::link::receive(message_type& type, std::string& payload) {
+    auto read_all = [this](char* data, size_t size) {
+        while (size != 0) {
+            ssize_t got = recv(fd, data, size, 0);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            data += got;
+            size -= got;
+        }
+        return true;
+    };
+    char header[9];
+    if (!read_all(header, sizeof(header)))
+        return false;
+    uint64_t length;
+    std::memcpy(&length, header + 1, sizeof(length));
+    type = (message_type) header[0];
+    payload.resize(length);
+    return read_all(payload.data(), length);
+}
+
+wc::cluster::cluster(const std::vector<std::string>& addresses, uint32_t rank,
+                     const std::string& settings)
+    : my_rank(rank), links(addresses.size()) {
+    std::string host, port;
+    split_address(addresses[rank], host, port);
+    int listener = rank + 1 < addresses.size() ? listen_on(port) : -1;
+    auto open_link = [](int fd) {
+        int on = 1;
+        // requests for work are small and waited for
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return std::make_unique<link>(fd);
+    };
+    for (uint32_t node = 0; node != rank; node++) {
+        links[node] = open_link(connect_to(addresses[node]));
+        links[node]->send(link::hello, hello_message(rank, settings));
+        if (read_hello(*links[node], settings) != node)
+            fail(addresses[node] + " is not node " + std::to_string(node));
+    }
+    for (uint32_t accepted = rank + 1; accepted != addresses.size(); accepted++) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            fail("cannot accept a node");
+        std::unique_ptr<link> incoming = open_link(fd);
+        uint32_t node = read_hello(*incoming, settings);
+        if (node <= rank || node >= addresses.size() || links[node])
+            fail("unexpected node " + std::to_string(node));
+        incoming->send(link::hello, hello_message(rank, settings));
+        links[node] = std::move(incoming);
+    }
+    if (listener >= 0)
+        close(listener);
+}
+
+void wc::cluster::hand_out(std::vector<work_item>&& items) {
+    std::lock_guard<std::mutex> lock(work_mtx);
+    work = std::move(items);
+    next_item = 0;
+    handed_out = true;
+    work_ready.notify_all();
+}
+
+std::vector<wc::work_item> wc::cluster::take_work(size_t count) {
+    std::unique_lock<std::mutex> lock(work_mtx);
+    work_ready.wait(lock, [this] { return handed_out; });
+    std::vector<work_item> taken;
+    for (; next_item != work.size() && taken.size() != count; next_item++)
+        taken.push_back(std::move(work[next_item]));
+    return taken;
+}
+
+std::string wc::encode_items(const std::vector<work_item>& items) {
+    std::string payload;
+    for (const work_item& item : items) {
+        put_string(payload, item.path.string());
+        put_varint(payload, item.offset);
+        put_varint(payload, item.length);
+        put_varint(payload, item.cost);
+    }
+    return payload;
+}
+
+bool wc::decode_items(std::string_view payload, std::vector<work_item>& items) {
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    while (p != end) {
+        work_item item;
+        std::string_view path;
+        if (!get_string(p, end, path) || !get_varint(p, end, item.offset) ||
+            !get_varint(p, end, item.length) || !get_varint(p, end, item.cost))
+            return false;
+        item.path = std::string(path);
+        items.push_back(std::move(item));
+    }
+    return true;
+}
+
+void wc::send_entries(link& to, uint32_t partition, const counter_table& table) {
+    std::string raw;
+    std::string payload;
+    auto flush = [&] {
+        payload.clear();
+        put_varint(payload, partition);
+        put_varint(payload, raw.size());
+        size_t header = payload.size();
+        uLongf packed = compressBound(raw.size());
+        payload.resize(header + packed);
+        if (compress2(reinterpret_cast<Bytef*>(&payload[header]), &packed,
+                      reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+                      Z_BEST_SPEED) != Z_OK)
+            fail("cannot compress a batch");
+        payload.resize(header + packed);
+        to.send(link::entries, payload);
+        raw.clear();
+    };
+    for (const counter_table::entry& e : table) {
+        put_string(raw, e.key());
+        put_varint(raw, e.count);
+        if (raw.size() >= batch_bytes)
+            flush();
+    }
+    if (!raw.empty())
+        flush();
+}
+
+bool wc::add_entries(std::string_view payload, std::vector<counter_table>& partitions) {
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    uint64_t partition, size;
+    if (!get_varint(p, end, partition) || !get_varint(p, end, size) ||
+        partition >= partitions.size())
+        return false;
+    std::string raw(size, '\0');
+    uLongf unpacked = size;
+    if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &unpacked,
+                   reinterpret_cast<const Bytef*>(p), end - p) != Z_OK ||
+        unpacked != size)
+        return false;
+    counter_table& table = partitions[partition];
+    p = raw.data();
+    end = p + raw.size();
+    while (p != end) {
+        std::string_view key;
+        uint64_t count;
+        if (!get_string(p, end, key) || !get_varint(p, end, count))
+            return false;
+        table.add(key, hash_key(key), count);
+    }
+    return true;
+}
+
+std::string wc::encode_tops(const std::vector<std::vector<ranked_entry>>& tops) {
+    std::string payload;
+    put_varint(payload, tops.size());
+    for (const std::vector<ranked_entry>& top : tops) {
+        put_varint(payload, top.size());
+        for (const ranked_entry& entry : top) {
+            put_string(payload, entry.first);
+            put_varint(payload, entry.second);
+        }
+    }
+    return payload;
+}
+
+bool wc::decode_tops(std::string_view payload,
+                     std::vector<std::vector<ranked_entry>>& tops) {
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    uint64_t num_orders;
+    if (!get_varint(p, end, num_orders))
+        return false;
+    tops.resize(num_orders);
+    for (std::vector<ranked_entry>& top : tops) {
+        uint64_t size;
+        if (!get_varint(p, end, size))
+            return false;
+        for (uint64_t i = 0; i != size; i++) {
+            std::string_view key;
+            uint64_t count;
+            if (!get_string(p, end, key) || !get_varint(p, end, count))
+                return false;
+            top.emplace_back(std::string(key), count);
+        }
+    }
+    return p == end;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "counter_table.hpp"
+#include "file_input.hpp"
+#include "top_k.hpp"
+
+namespace wc {
+/* a TCP connection to another node of a cluster, carrying whole messages: a
+type byte, a 64-bit payload length and the payload. Any thread may send, a
+message is never interleaved with another; one thread at a time receives.
+A broken connection ends the count, there is no way to finish without the
+node at the other end. */
+class link {
+    int fd;
+    std::mutex send_mtx;
+
+   public:
+    enum message_type : uint8_t {
+        // hello, the first message each way: rank and settings of the sender
+        hello,
+        // a node asks the first one for work and gets up to a batch of items,
+        // an empty batch once there is none left
+        work_request,
+        work_items,
+        // compressed entries of one partition, any number per partition
+        entries,
+        // the sender has sent every entry it counted
+        entries_done,
+        // the top k of each order from the partitions of the sender
+        tops
+    };
+
+    explicit link(int fd) : fd(fd) {}
+    ~link();
+    link(const link&) = delete;
+    link& operator=(const link&) = delete;
+
+    void send(message_type type, std::string_view payload);
+    // false if the connection was closed or broke
+    bool receive(message_type& type, std::string& payload);
+};
+
+/* the nodes of a multi-node count, connected all to all. The i-th node
+listens on the i-th address, connects to every node before it and accepts
+every node after it. The first node is the coordinator: it lists the
+corpus, hands out its work items to the nodes that ask and prints the
+result. */
+class cluster {
+    uint32_t my_rank;
+    std::vector<std::unique_ptr<link>> links;
+
+    std::mutex work_mtx;
+    std::condition_variable work_ready;
+    bool handed_out = false;
+    std::vector<work_item> work;
+    size_t next_item = 0;
+
+   public:
+    /* connects to every other node, exits if that fails. `settings` must be
+    the same on every node. */
+    cluster(const std::vector<std::string>& addresses, uint32_t rank,
+            const std::string& settings);
+
+    uint32_t size() const { return links.size(); }
+    uint32_t rank() const { return my_rank; }
+    link& peer(uint32_t node) { return *links[node]; }
+
+    // on the coordinator: the items to hand out, in order
+    void hand_out(std::vector<work_item>&& items);
+    // up to `count` of the items not handed out yet, waits for hand_out()
+    std::vector<work_item> take_work(size_t count);
+};
+
+std::string encode_items(const std::vector<work_item>& items);
+bool decode_items(std::string_view payload, std::vector<work_item>& items);
+
+// sends the entries of a table in zlib-compressed batches
+void send_entries(link& to, uint32_t partition, const counter_table& table);
+// adds the entries of a batch to the table of its partition, keys are text
+bool add_entries(std::string_view payload, std::vector<counter_table>& partitions);
+
+std::string encode_tops(const std::vector<std::vector<ranked_entry>>& tops);
+bool decode_tops(std::string_view payload, std::vector<std::vector<ranked_entry>>& tops);
+}  // namespace wc
@@ -0,0 +1,241 @@
+#include "count_store.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// read a varint at `p`, false if it runs past `end`
+bool get_varint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+}  // namespace
+
+fs::path wc::store_file(const fs::path& dir, uint32_t partition) {
+    return dir / ("part-" + std::to_string(partition) + ".ngc");
+}
+
+void wc::remove_stale_partitions(const fs::path& dir, uint32_t num_partitions) {
+    std::error_code ec;
+    uint32_t i = num_partitions;
+    while (fs::remove(store_file(dir, i), ec)) i++;
+}
+
+wc::store_writer::store_writer(const fs::path& file, uint32_t partition,
+                               uint32_t num_partitions)
+    : out(file, std::ios::binary | std::ios::trunc) {
+    std::memcpy(header.magic, store_header::magic_bytes, sizeof(header.magic));
+    header.partition = partition;
+    header.num_partitions = num_partitions;
+    header.block_entries = block_entries;
+    header.num_entries = 0;
+    header.index_offset = 0;
+    // the header is rewritten by finish()
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void wc::store_writer::put_varint(uint64_t value) {
+    while (value >= 0x80) {
+        pending.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    pending.push_back((char) value);
+}
+
+void wc::store_writer::add(std::string_view key, uint64_t count) {
+    size_t shared = 0;
+    if (header.num_entries % block_entries == 0) {
+        index.push_back(offset + pending.size());
+    } else {
+        size_t limit = std::min(previous.size(), key.size());
+        while (shared != limit && previous[shared] == key[shared]) shared++;
+    }
+    put_varint(shared);
+    put_varint(key.size() - shared);
+    pending.append(key.substr(shared));
+    put_varint(count);
+    previous.assign(key);
+    header.num_entries++;
+    if (pending.size() >= 1 << 16) {
+        out.write(pending.data(), pending.size());
+        offset += pending.size();
+        pending.clear();
+    }
+}
+
+bool wc::store_writer::finish() {
+    out.write(pending.data(), pending.size());
+    header.index_offset = offset + pending.size();
+    out.write(reinterpret_cast<const char*>(index.data()),
+              index.size() * sizeof(uint64_t));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    return !out.fail();
+}
+
+wc::store_reader::store_reader(const fs::path& file, access_pattern access) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(store_header)) {
+        close(fd);
+        return;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return;
+    std::memcpy(&header, addr, sizeof(header));
+    size_t index_bytes = st.st_size - header.index_offset;
+    if (std::memcmp(header.magic, store_header::magic_bytes, sizeof(header.magic)) != 0 ||
+        header.index_offset < sizeof(header) || header.index_offset > (size_t) st.st_size ||
+        index_bytes % sizeof(uint64_t) != 0 || header.block_entries == 0) {
+        munmap(addr, st.st_size);
+        return;
+    }
+    base = static_cast<const char*>(addr);
+    size = st.st_size;
+    // the index need not be aligned, its entries are read through memcpy
+    index = base + header.index_offset;
+    num_blocks = index_bytes / sizeof(uint64_t);
+    madvise(addr, size, access == access_pattern::random ? MADV_RANDOM : MADV_SEQUENTIAL);
+}
+
+wc::store_reader::~store_reader() {
+    if (base != nullptr)
+        munmap(const_cast<char*>(base), size);
+}
+
+const char* wc::store_reader::block_start(size_t block) const {
+    uint64_t at;
+    std::memcpy(&at, index + block * sizeof(uint64_t), sizeof(at));
+    return base + std::min<uint64_t>(at, header.index_offset);
+}
+
+std::string_view wc::store_reader::first_key(size_t block) const {
+    const char* p = block_start(block);
+    const char* end = base + header.index_offset;
+    uint64_t shared, length;
+    if (!get_varint(p, end, shared) || !get_varint(p, end, length) ||
+        length > (uint64_t) (end - p))
+        return {};
+    return {p, length};
+}
+
+uint64_t wc::store_reader::find(std::string_view key) const {
+    store_cursor cursor(*this, key);
+    return cursor.valid() && cursor.key() == key ? cursor.count() : 0;
+}
+
+void wc::store_reader::block_keys(std::vector<std::string>& keys) const {
+    for (size_t i = 0; i != num_blocks; i++) keys.emplace_back(first_key(i));
+}
+
+wc::store_cursor::store_cursor(const store_reader& reader, std::string_view from) {
+    if (reader.num_blocks == 0)
+        return;
+    // the last block whose first key is not greater than `from`
+    size_t low = 0, high = reader.num_blocks;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (reader.first_key(mid) <= from)
+            low = mid;
+        else
+            high = mid;
+    }
+    // blocks follow each other and each restarts the prefix, so the walk
+    // simply carries on into the next block
+    p = reader.block_start(low);
+    end = reader.base + reader.header.index_offset;
+    next();
+    while (at_entry && key() < from) next();
+}
+
+void wc::store_cursor::next() {
+    at_entry = false;
+    if (p == end)
+        return;
+    uint64_t shared, length;
+    if (!get_varint(p, end, shared) || !get_varint(p, end, length) ||
+        shared > current.size() || length > (uint64_t) (end - p)) {
+        p = end;
+        return;
+    }
+    current.resize(shared);
+    current.append(p, length);
+    p += length;
+    if (!get_varint(p, end, current_count)) {
+        p = end;
+        return;
+    }
+    at_entry = true;
+}
+
+wc::sorted_merge::sorted_merge(std::vector<store_cursor>&& cursors,
+                               const std::string* to)
+    : cursors(std::move(cursors)), to(to) {
+    auto cmp = [this](size_t a, size_t b) { return later(a, b); };
+    for (size_t i = 0; i != this->cursors.size(); i++) {
+        if (in_range(i)) {
+            heads.push_back(i);
+            std::push_heap(heads.begin(), heads.end(), cmp);
+        }
+    }
+}
+
+bool wc::sorted_merge::next(std::string_view& key, uint64_t& count) {
+    if (heads.empty())
+        return false;
+    auto cmp = [this](size_t a, size_t b) { return later(a, b); };
+    current.assign(cursors[heads.front()].key());
+    count = 0;
+    while (!heads.empty() && cursors[heads.front()].key() == current) {
+        std::pop_heap(heads.begin(), heads.end(), cmp);
+        size_t i = heads.back();
+        count += cursors[i].count();
+        cursors[i].next();
+        if (in_range(i))
+            std::push_heap(heads.begin(), heads.end(), cmp);
+        else
+            heads.pop_back();
+    }
+    key = current;
+    return true;
+}
+
+wc::count_store::count_store(const fs::path& dir, access_pattern access) {
+    auto first = std::make_unique<store_reader>(store_file(dir, 0), access);
+    if (!first->is_open())
+        return;
+    uint32_t num_partitions = first->num_partitions();
+    partitions.push_back(std::move(first));
+    for (uint32_t i = 1; i < num_partitions; i++) {
+        auto reader = std::make_unique<store_reader>(store_file(dir, i), access);
+        if (!reader->is_open() || reader->num_partitions() != num_partitions) {
+            partitions.clear();
+            return;
+        }
+        partitions.push_back(std::move(reader));
+    }
+}
+
+uint64_t wc::count_store::find(std::string_view key) const {
+    for (const auto& partition : partitions) {
+        if (uint64_t count = partition->find(key))
+            return count;
+    }
+    return 0;
+}
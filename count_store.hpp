@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* on-disk counts of one partition, in native byte order:
+
+    header   magic "ngc1", partition, number of partitions, entries per
+             block (u32 each), number of entries, offset of the index (u64)
+    blocks   per entry: varint bytes shared with the previous key of the
+             block, varint length of the rest, the rest, varint count
+    index    u64 file offset of every block
+
+Keys are n-gram texts in increasing byte order. The first key of a block is
+stored whole, so a lookup binary searches the index on those keys and then
+scans a single block. */
+struct store_header {
+    static constexpr char magic_bytes[4] = {'n', 'g', 'c', '1'};
+
+    char magic[4];
+    uint32_t partition;
+    uint32_t num_partitions;
+    uint32_t block_entries;
+    uint64_t num_entries;
+    uint64_t index_offset;
+};
+
+// the file holding one partition inside a store directory
+fs::path store_file(const fs::path& dir, uint32_t partition);
+// remove the partition files past `num_partitions` left by an earlier run
+void remove_stale_partitions(const fs::path& dir, uint32_t num_partitions);
+
+// writes one partition file, keys must be added in increasing order
+class store_writer {
+    static constexpr uint32_t block_entries = 64;
+
+    std::ofstream out;
+    store_header header;
+    std::vector<uint64_t> index;
+    std::string previous;
+    std::string pending;
+    uint64_t offset = sizeof(store_header);
+
+    void put_varint(uint64_t value);
+
+   public:
+    store_writer(const fs::path& file, uint32_t partition, uint32_t num_partitions);
+    void add(std::string_view key, uint64_t count);
+    // write the index and the header; false if any write failed
+    bool finish();
+};
+
+// how a mapped store file is read, for the kernel's readahead
+enum class access_pattern {
+    // point lookups, which jump around the file
+    random,
+    // cursors walking it from start to end, as merges and spill runs do
+    sequential
+};
+
+// one partition file mapped read-only
+class store_reader {
+    const char* base = nullptr;
+    size_t size = 0;
+    store_header header{};
+    const char* index = nullptr;
+    size_t num_blocks = 0;
+
+    const char* block_start(size_t block) const;
+    std::string_view first_key(size_t block) const;
+
+    friend class store_cursor;
+
+   public:
+    store_reader(const fs::path& file, access_pattern access);
+    ~store_reader();
+    store_reader(const store_reader&) = delete;
+    store_reader& operator=(const store_reader&) = delete;
+
+    // false if the file is missing or not a partition file
+    bool is_open() const { return base != nullptr; }
+    uint32_t num_partitions() const { return header.num_partitions; }
+    uint64_t size_in_entries() const { return header.num_entries; }
+    // count of `key`, 0 if it is not in the partition
+    uint64_t find(std::string_view key) const;
+    // the first key of every block, in order
+    void block_keys(std::vector<std::string>& keys) const;
+};
+
+// walks the entries of a partition file in key order
+class store_cursor {
+    const char* p = nullptr;
+    const char* end = nullptr;
+    std::string current;
+    uint64_t current_count = 0;
+    bool at_entry = false;
+
+   public:
+    // positioned on the first entry whose key is not less than `from`
+    store_cursor(const store_reader& reader, std::string_view from);
+
+    bool valid() const { return at_entry; }
+    std::string_view key() const { return current; }
+    uint64_t count() const { return current_count; }
+    void next();
+};
+
+/* an entry on its way into a store file. Keys are ordered by their bytes;
+the first eight of them, big endian, settle most comparisons. */
+struct sorted_entry {
+    uint64_t prefix;
+    std::string_view key;
+    uint64_t count;
+
+    sorted_entry(std::string_view key, uint64_t count) : prefix(0), key(key), count(count) {
+        for (size_t i = 0; i != 8; i++)
+            prefix = prefix << 8 | (i < key.size() ? (uint8_t) key[i] : 0);
+    }
+    bool operator<(const sorted_entry& other) const {
+        return prefix < other.prefix || (prefix == other.prefix && key < other.key);
+    }
+};
+
+/* k-way merge of sorted partition files, each read through a cursor up to
+an optional end key; equal keys come out once, their counts summed */
+class sorted_merge {
+    std::vector<store_cursor> cursors;
+    const std::string* to;
+    std::vector<size_t> heads;
+    std::string current;
+
+    bool in_range(size_t i) const {
+        return cursors[i].valid() && (to == nullptr || cursors[i].key() < *to);
+    }
+    // the cursor with the smallest key first
+    bool later(size_t a, size_t b) const { return cursors[a].key() > cursors[b].key(); }
+
+   public:
+    explicit sorted_merge(std::vector<store_cursor>&& cursors,
+                          const std::string* to = nullptr);
+    // the next key and its total count, false once every cursor is done
+    bool next(std::string_view& key, uint64_t& count);
+};
+
+/* every partition of a store directory. Which partition holds a key depends
+on the key mode of the run, so a lookup tries each of them. */
+class count_store {
+    std::vector<std::unique_ptr<store_reader>> partitions;
+
+   public:
+    // false from is_open() if the directory holds no complete store
+    count_store(const fs::path& dir, access_pattern access);
+    bool is_open() const { return !partitions.empty(); }
+    uint64_t find(std::string_view key) const;
+    const std::vector<std::unique_ptr<store_reader>>& files() const {
+        return partitions;
+    }
+};
+}  // namespace wc
@@ -0,0 +1,84 @@
+#include "counter_table.hpp"
+
+#include <utility>
+
+uint64_t wc::counter_table::find(std::string_view key, uint64_t hash) const {
+    const entry* e = lookup(key, hash);
+    return e == nullptr ? 0 : e->count;
+}
+
+void wc::counter_table::merge(counter_table&& other) {
+    if (other.size() > size()) {
+        swap(other);
+        // the rehashes of the larger table were counted where they happened
+        std::swap(num_rehashes, other.num_rehashes);
+    }
+    for (const entry& e : other) {
+        if (entry* mine = lookup(e.key(), e.hash))
+            mine->count += e.count;
+        else
+            insert_new(e.hash) = e;
+    }
+    arena.adopt(std::move(other.arena));
+    other.clear();
+}
+
+void wc::counter_table::absorb(const counter_table& other) {
+    for (const entry& e : other) add(e.key(), e.hash, e.count);
+}
+
+void wc::counter_table::reserve(size_t num_keys) {
+    size_t new_capacity = detail::ctrl_group::width;
+    while (new_capacity * 7 < num_keys * 8) new_capacity *= 2;
+    if (new_capacity > capacity)
+        rehash(new_capacity);
+}
+
+void wc::counter_table::clear() {
+    ctrl.reset();
+    slots.reset();
+    capacity = 0;
+    num_entries = 0;
+    arena.clear();
+}
+
+void wc::counter_table::swap(counter_table& other) noexcept {
+    std::swap(ctrl, other.ctrl);
+    std::swap(slots, other.slots);
+    std::swap(capacity, other.capacity);
+    std::swap(num_entries, other.num_entries);
+    std::swap(num_rehashes, other.num_rehashes);
+    std::swap(arena, other.arena);
+}
+
+size_t wc::counter_table::find_empty(uint64_t hash) const {
+    size_t mask = capacity - 1;
+    size_t pos = probe_start(hash);
+    for (size_t step = 0;; step += detail::ctrl_group::width) {
+        pos = (pos + step) & mask;
+        uint32_t empty = detail::ctrl_group(ctrl.get() + pos).match_empty();
+        if (empty != 0)
+            return (pos + __builtin_ctz(empty)) & mask;
+    }
+}
+
+void wc::counter_table::rehash(size_t new_capacity) {
+    std::unique_ptr<int8_t[]> old_ctrl = std::move(ctrl);
+    std::unique_ptr<entry[]> old_slots = std::move(slots);
+    size_t old_capacity = capacity;
+
+    if (old_capacity != 0)
+        num_rehashes++;
+    capacity = new_capacity;
+    ctrl.reset(new int8_t[capacity + detail::ctrl_group::width]);
+    std::fill(ctrl.get(), ctrl.get() + capacity + detail::ctrl_group::width,
+              detail::ctrl_group::empty);
+    slots.reset(new entry[capacity]);
+    for (size_t i = 0; i != old_capacity; i++) {
+        if (old_ctrl[i] < 0)
+            continue;
+        size_t index = find_empty(old_slots[i].hash);
+        set_ctrl(index, old_ctrl[i]);
+        slots[index] = old_slots[i];
+    }
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+#include "key_arena.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace wc {
+// the one hash every n-gram gets, computed when it is emitted
+inline uint64_t hash_key(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+// the reducer owning a key; uses the high bits, tables use the low ones
+inline uint32_t partition_of(uint64_t hash, uint32_t num_partitions) {
+    return (uint32_t) (((hash >> 32) * num_partitions) >> 32);
+}
+
+namespace detail {
+/* sixteen control bytes of a counter_table. A control byte is either
+`empty` or the low seven bits of the hash of the key in that slot, so one
+vector compare finds every candidate slot of a group. */
+struct ctrl_group {
+    static constexpr size_t width = 16;
+    static constexpr int8_t empty = -128;
+#if defined(__SSE2__)
+    __m128i bytes;
+    explicit ctrl_group(const int8_t* p)
+        : bytes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+    uint32_t match(int8_t h2) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(h2)));
+    }
+    // only empty control bytes have the sign bit set
+    uint32_t match_empty() const { return _mm_movemask_epi8(bytes); }
+#elif defined(__ARM_NEON)
+    int8x16_t bytes;
+    explicit ctrl_group(const int8_t* p) : bytes(vld1q_s8(p)) {}
+    static uint32_t to_mask(uint8x16_t eq) {
+        static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                         1, 2, 4, 8, 16, 32, 64, 128};
+        uint8x16_t masked = vandq_u8(eq, vld1q_u8(bits));
+        return vaddv_u8(vget_low_u8(masked)) |
+               (vaddv_u8(vget_high_u8(masked)) << 8);
+    }
+    uint32_t match(int8_t h2) const {
+        return to_mask(vceqq_s8(bytes, vdupq_n_s8(h2)));
+    }
+    uint32_t match_empty() const {
+        return to_mask(vcltq_s8(bytes, vdupq_n_s8(0)));
+    }
+#else
+    int8_t bytes[width];
+    explicit ctrl_group(const int8_t* p) { std::memcpy(bytes, p, width); }
+    uint32_t match(int8_t h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i != width; i++) mask |= (uint32_t) (bytes[i] == h2) << i;
+        return mask;
+    }
+    uint32_t match_empty() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i != width; i++) mask |= (uint32_t) (bytes[i] < 0) << i;
+        return mask;
+    }
+#endif
+};
+}  // namespace detail
+
+/* flat open-addressing table from n-gram to count, in the style of a
+SwissTable: a control byte per slot holds seven bits of the stored hash and
+is probed a group of sixteen at a time, and the slots hold a handle to the
+key, its full hash and its count side by side. Key bytes live in the table's
+own arena, except keys of up to eight bytes which are kept in the handle.
+Entries are never erased. */
+class counter_table {
+   public:
+    struct entry {
+        static constexpr uint32_t inline_size = sizeof(const char*);
+
+        uint64_t hash;
+        uint64_t count;
+        union {
+            const char* data;
+            char bytes[inline_size];
+        };
+        uint32_t length;
+
+        std::string_view key() const {
+            return {length <= inline_size ? bytes : data, length};
+        }
+    };
+
+    template <class Entry>
+    class basic_iterator {
+        const int8_t* ctrl;
+        Entry* slot;
+        Entry* end;
+
+        void skip_empty() {
+            while (slot != end && *ctrl < 0) {
+                ctrl++;
+                slot++;
+            }
+        }
+
+       public:
+        basic_iterator(const int8_t* ctrl, Entry* slot, Entry* end)
+            : ctrl(ctrl), slot(slot), end(end) {
+            skip_empty();
+        }
+        Entry& operator*() const { return *slot; }
+        Entry* operator->() const { return slot; }
+        basic_iterator& operator++() {
+            ctrl++;
+            slot++;
+            skip_empty();
+            return *this;
+        }
+        bool operator!=(const basic_iterator& other) const {
+            return slot != other.slot;
+        }
+        bool operator==(const basic_iterator& other) const {
+            return slot == other.slot;
+        }
+    };
+    using iterator = basic_iterator<entry>;
+    using const_iterator = basic_iterator<const entry>;
+
+    counter_table() = default;
+    counter_table(counter_table&& other) noexcept { swap(other); }
+    counter_table& operator=(counter_table&& other) noexcept {
+        counter_table(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    size_t size() const { return num_entries; }
+    bool empty() const { return num_entries == 0; }
+    // bytes held by the control bytes, the slots and the key arena
+    size_t memory_bytes() const {
+        return arena.memory_bytes() +
+               (capacity == 0 ? 0
+                              : capacity * sizeof(entry) + capacity +
+                                    detail::ctrl_group::width);
+    }
+
+    // how often the table has been rehashed to grow, kept on clear() and merge()
+    uint64_t rehashes() const { return num_rehashes; }
+
+    iterator begin() { return {ctrl.get(), slots.get(), slots.get() + capacity}; }
+    iterator end() {
+        return {ctrl.get(), slots.get() + capacity, slots.get() + capacity};
+    }
+    const_iterator begin() const {
+        return {ctrl.get(), slots.get(), slots.get() + capacity};
+    }
+    const_iterator end() const {
+        return {ctrl.get(), slots.get() + capacity, slots.get() + capacity};
+    }
+
+    // add `count` occurrences of `key`, whose hash_key() is `hash`
+    void add(std::string_view key, uint64_t hash, uint64_t count = 1) {
+        entry& e = find_or_insert(key, hash);
+        e.count += count;
+    }
+    // count of `key`, 0 if it was never added
+    uint64_t find(std::string_view key, uint64_t hash) const;
+    /* move every entry of `other` into this table, summing shared keys. The
+    arena of `other` is adopted whole, key bytes are never copied. */
+    void merge(counter_table&& other);
+    /* add every entry of `other`, copying its key bytes, so that all of this
+    table stays in memory it allocated itself: first touched by its own thread
+    and local to that thread's NUMA node */
+    void absorb(const counter_table& other);
+    void reserve(size_t num_keys);
+    void clear();
+    void swap(counter_table& other) noexcept;
+
+   private:
+    std::unique_ptr<int8_t[]> ctrl;
+    std::unique_ptr<entry[]> slots;
+    size_t capacity = 0;
+    size_t num_entries = 0;
+    uint64_t num_rehashes = 0;
+    key_arena arena;
+
+    static int8_t h2(uint64_t hash) { return (int8_t) (hash & 0x7f); }
+    size_t probe_start(uint64_t hash) const { return (hash >> 7) & (capacity - 1); }
+    void set_ctrl(size_t index, int8_t value) {
+        ctrl[index] = value;
+        // the first group is mirrored past the end so loads never wrap
+        if (index < detail::ctrl_group::width)
+            ctrl[capacity + index] = value;
+    }
+    bool needs_growth() const {
+        return (num_entries + 1) * 8 > capacity * 7;
+    }
+    void rehash(size_t new_capacity);
+    size_t find_empty(uint64_t hash) const;
+
+    entry* lookup(std::string_view key, uint64_t hash) const {
+        if (capacity == 0)
+            return nullptr;
+        size_t mask = capacity - 1;
+        size_t pos = probe_start(hash);
+        for (size_t step = 0;; step += detail::ctrl_group::width) {
+            pos = (pos + step) & mask;
+            detail::ctrl_group group(ctrl.get() + pos);
+            for (uint32_t m = group.match(h2(hash)); m != 0; m &= m - 1) {
+                entry& e = slots[(pos + __builtin_ctz(m)) & mask];
+                if (e.hash == hash && e.key() == key)
+                    return &e;
+            }
+            if (group.match_empty() != 0)
+                return nullptr;
+        }
+    }
+
+    // claim a slot for a key known to be absent, its count starts at 0
+    entry& insert_new(uint64_t hash) {
+        if (needs_growth())
+            rehash(capacity == 0 ? detail::ctrl_group::width : capacity * 2);
+        size_t index = find_empty(hash);
+        set_ctrl(index, h2(hash));
+        num_entries++;
+        entry& e = slots[index];
+        e.hash = hash;
+        e.count = 0;
+        return e;
+    }
+
+    entry& find_or_insert(std::string_view key, uint64_t hash) {
+        if (entry* e = lookup(key, hash))
+            return *e;
+        entry& e = insert_new(hash);
+        e.length = key.size();
+        if (key.size() <= entry::inline_size)
+            std::copy(key.begin(), key.end(), e.bytes);
+        else
+            e.data = arena.store(key);
+        return e;
+    }
+};
+}  // namespace wc
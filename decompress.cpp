@@ -0,0 +1,248 @@
+#include "decompress.hpp"
+
+#include <zlib.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef NGC_ZSTD
+#include <zstd.h>
+#endif
+
+#include "char_class.hpp"
+
+namespace {
+// decoded bytes handed to the caller at a time, and compressed bytes read
+const size_t block_size = 4 << 20;
+const size_t input_size = 1 << 18;
+
+// a stream of decoded bytes; read() returns 0 at the end or once it failed
+class decoder {
+   protected:
+    std::ifstream in;
+    std::unique_ptr<char[]> input{new char[input_size]};
+    bool damaged = false;
+
+    size_t refill() {
+        in.read(input.get(), input_size);
+        return in.gcount();
+    }
+
+   public:
+    explicit decoder(const fs::path& file) : in(file, std::ios::binary) {}
+    virtual ~decoder() = default;
+    bool opened() const { return bool(in); }
+    bool failed() const { return damaged; }
+    virtual size_t read(char* out, size_t capacity) = 0;
+};
+
+class gzip_decoder : public decoder {
+    z_stream zs{};
+    bool initialized;
+    // at the start of the file or past the end of a member
+    bool between_members = true;
+
+   public:
+    explicit gzip_decoder(const fs::path& file) : decoder(file) {
+        // 32 lets zlib detect the gzip header
+        initialized = inflateInit2(&zs, 15 + 32) == Z_OK;
+        damaged = !initialized;
+    }
+    ~gzip_decoder() override {
+        if (initialized)
+            inflateEnd(&zs);
+    }
+
+    size_t read(char* out, size_t capacity) override {
+        if (damaged)
+            return 0;
+        zs.next_out = reinterpret_cast<Bytef*>(out);
+        zs.avail_out = capacity;
+        while (zs.avail_out == capacity) {
+            if (zs.avail_in == 0) {
+                size_t got = refill();
+                if (got == 0) {
+                    // a member cut short is damage, the end of one is not
+                    damaged = !between_members;
+                    return 0;
+                }
+                zs.next_in = reinterpret_cast<Bytef*>(input.get());
+                zs.avail_in = got;
+            }
+            if (between_members) {
+                inflateReset(&zs);
+                between_members = false;
+            }
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                between_members = true;
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                damaged = true;
+                break;
+            }
+        }
+        return capacity - zs.avail_out;
+    }
+};
+
+#ifdef NGC_ZSTD
+class zstd_decoder : public decoder {
+    ZSTD_DStream* ds = ZSTD_createDStream();
+    ZSTD_inBuffer source{nullptr, 0, 0};
+    bool between_frames = true;
+
+   public:
+    explicit zstd_decoder(const fs::path& file) : decoder(file) {
+        damaged = ds == nullptr || ZSTD_isError(ZSTD_initDStream(ds));
+    }
+    ~zstd_decoder() override { ZSTD_freeDStream(ds); }
+
+    size_t read(char* out, size_t capacity) override {
+        if (damaged)
+            return 0;
+        ZSTD_outBuffer sink{out, capacity, 0};
+        while (sink.pos == 0) {
+            if (source.pos == source.size) {
+                size_t got = refill();
+                if (got == 0) {
+                    damaged = !between_frames;
+                    return 0;
+                }
+                source = {input.get(), got, 0};
+            }
+            // frames follow each other, the stream starts the next by itself
+            size_t ret = ZSTD_decompressStream(ds, &sink, &source);
+            if (ZSTD_isError(ret)) {
+                damaged = true;
+                break;
+            }
+            between_frames = ret == 0;
+        }
+        return sink.pos;
+    }
+};
+#endif
+
+std::unique_ptr<decoder> open_decoder(const fs::path& file, wc::compression c) {
+    std::unique_ptr<decoder> d;
+    if (c == wc::compression::gzip)
+        d = std::make_unique<gzip_decoder>(file);
+#ifdef NGC_ZSTD
+    else if (c == wc::compression::zstd)
+        d = std::make_unique<zstd_decoder>(file);
+#endif
+    if (d && !d->opened())
+        d.reset();
+    return d;
+}
+
+// one past the last sentence break in text[0, size), npos if there is none
+size_t after_last_break(const std::string& text, size_t size) {
+    for (size_t i = size; i != 0; i--)
+        if (wc::classify(text[i - 1]) == wc::char_class::sentence_break)
+            return i;
+    return std::string::npos;
+}
+}  // namespace
+
+wc::compression wc::compression_of(const fs::path& file) {
+    std::string extension = file.extension().string();
+    if (extension == ".gz")
+        return compression::gzip;
+    if (extension == ".zst")
+        return compression::zstd;
+    return compression::none;
+}
+
+bool wc::can_decompress(compression c) {
+#ifdef NGC_ZSTD
+    return true;
+#else
+    return c != compression::zstd;
+#endif
+}
+
+std::vector<std::string> wc::default_extensions() {
+    std::vector<std::string> extensions{".txt", ".txt.gz"};
+    if (can_decompress(compression::zstd))
+        extensions.push_back(".txt.zst");
+    return extensions;
+}
+
+bool wc::decompress(const fs::path& file, compression c,
+                    const std::function<void(std::string_view)>& fn) {
+    std::unique_ptr<decoder> d = open_decoder(file, c);
+    if (!d)
+        return false;
+
+    // two blocks: the caller counts one while the other is decoded
+    struct block {
+        std::string bytes;
+        size_t length = 0;
+        bool full = false;
+        bool last = false;
+    };
+    block blocks[2];
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    std::thread decoding([&] {
+        // the sentence a block ended in the middle of starts the next one
+        std::string tail;
+        for (size_t i = 0;; i ^= 1) {
+            block& b = blocks[i];
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&b] { return !b.full; });
+            }
+            b.bytes.assign(tail);
+            size_t used = b.bytes.size();
+            b.bytes.resize(std::max(block_size, 2 * used));
+            bool end = false;
+            size_t stop;
+            for (;;) {
+                while (used < b.bytes.size() && !end) {
+                    size_t got = d->read(&b.bytes[used], b.bytes.size() - used);
+                    end = got == 0;
+                    used += got;
+                }
+                stop = end ? used : after_last_break(b.bytes, used);
+                if (stop != std::string::npos)
+                    break;
+                // a sentence longer than a block
+                b.bytes.resize(2 * b.bytes.size());
+            }
+            tail.assign(b.bytes, stop, used - stop);
+            std::lock_guard<std::mutex> lock(mtx);
+            b.length = stop;
+            b.last = end;
+            b.full = true;
+            cv.notify_all();
+            if (end)
+                return;
+        }
+    });
+
+    for (size_t i = 0;; i ^= 1) {
+        block& b = blocks[i];
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&b] { return b.full; });
+        }
+        if (b.length != 0)
+            fn(std::string_view(b.bytes.data(), b.length));
+        bool last = b.last;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            b.full = false;
+        }
+        cv.notify_all();
+        if (last)
+            break;
+    }
+    decoding.join();
+    return !d->failed();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace wc {
+// how the bytes of an input file are stored, told by its last extension
+enum class compression { none, gzip, zstd };
+
+compression compression_of(const fs::path& file);
+
+// whether this build can decode `c`; zstd needs make ZSTD=1
+bool can_decompress(compression c);
+
+// the names counted by default: .txt, and .txt.gz and .txt.zst where they
+// can be decoded
+std::vector<std::string> default_extensions();
+
+/* decode `file` and hand its text to `fn` in blocks of whole sentences, each
+view valid until fn returns. A thread of its own decodes the next block
+while fn counts the current one, so decoding overlaps with tokenizing.
+Catenated gzip members and zstd frames are read one after another. Returns
+false, after handing over whatever came before the damage, if the file
+cannot be opened or decoded. */
+bool decompress(const fs::path& file, compression c,
+                const std::function<void(std::string_view)>& fn);
+}  // namespace wc
@@ -0,0 +1,149 @@
+#include "dump.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <queue>
+#include <thread>
+
+namespace {
+// bytes a thread formats before it writes them out
+const size_t write_block = 16 << 20;
+// samples taken from each partition per range, to place the splitters
+const size_t samples_per_range = 16;
+
+size_t digits(uint64_t value) {
+    size_t n = 1;
+    for (; value >= 10; value /= 10) n++;
+    return n;
+}
+
+size_t entry_bytes(const wc::dump_entry& e, wc::dump_format format) {
+    if (format == wc::dump_format::tsv)
+        return e.key.size() + digits(e.count) + 2;
+    return sizeof(uint64_t) + sizeof(uint32_t) + e.key.size();
+}
+
+void append_entry(std::string& out, const wc::dump_entry& e, wc::dump_format format) {
+    if (format == wc::dump_format::tsv) {
+        char number[20];
+        char* end = std::to_chars(number, number + sizeof(number), e.count).ptr;
+        out.append(e.key);
+        out.push_back('\t');
+        out.append(number, end);
+        out.push_back('\n');
+        return;
+    }
+    uint32_t length = e.key.size();
+    out.append(reinterpret_cast<const char*>(&e.count), sizeof(e.count));
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(e.key);
+}
+
+bool write_at(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size != 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+template <class Fn>
+void on_threads(size_t count, Fn fn) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != count; i++) threads.push_back(std::thread(fn, i));
+    for (std::thread& t : threads) t.join();
+}
+}  // namespace
+
+bool wc::write_dump(const fs::path& file, dump_format format,
+                    const std::vector<ranked_partition>& partitions, uint32_t num_threads) {
+    // every partition is ranked, so evenly spaced samples of each, ranked
+    // together, give splitters that cut the whole ranking into even ranges
+    std::vector<dump_entry> samples;
+    uint64_t num_entries = 0;
+    for (const ranked_partition& p : partitions) {
+        num_entries += p.entries.size();
+        size_t step = std::max<size_t>(1, p.entries.size() / (samples_per_range * num_threads));
+        for (size_t i = step / 2; i < p.entries.size(); i += step) samples.push_back(p.entries[i]);
+    }
+    std::sort(samples.begin(), samples.end());
+    std::vector<dump_entry> splitters;
+    for (uint32_t r = 1; r < num_threads && !samples.empty(); r++)
+        splitters.push_back(samples[r * samples.size() / num_threads]);
+    size_t num_ranges = splitters.size() + 1;
+
+    // range r takes entries [starts[r][p], starts[r + 1][p]) of partition p
+    std::vector<std::vector<size_t>> starts(num_ranges + 1,
+                                            std::vector<size_t>(partitions.size()));
+    for (size_t p = 0; p != partitions.size(); p++) {
+        const std::vector<dump_entry>& entries = partitions[p].entries;
+        for (size_t r = 1; r != num_ranges; r++)
+            starts[r][p] = std::lower_bound(entries.begin(), entries.end(), splitters[r - 1]) -
+                           entries.begin();
+        starts[num_ranges][p] = entries.size();
+    }
+
+    // size every range, then lay the ranges out one after another
+    std::vector<uint64_t> offsets(num_ranges + 1);
+    on_threads(num_ranges, [&](size_t r) {
+        uint64_t bytes = 0;
+        for (size_t p = 0; p != partitions.size(); p++)
+            for (size_t i = starts[r][p]; i != starts[r + 1][p]; i++)
+                bytes += entry_bytes(partitions[p].entries[i], format);
+        offsets[r + 1] = bytes;
+    });
+    offsets[0] = format == dump_format::binary ? sizeof(dump_header) : 0;
+    for (size_t r = 0; r != num_ranges; r++) offsets[r + 1] += offsets[r];
+
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = ftruncate(fd, offsets[num_ranges]) == 0;
+    if (format == dump_format::binary) {
+        dump_header header;
+        std::memcpy(header.magic, dump_header::magic_bytes, sizeof(header.magic));
+        header.reserved = 0;
+        header.num_entries = num_entries;
+        ok = ok && write_at(fd, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+    }
+
+    // each thread merges its range of every partition and writes it in place
+    std::vector<char> written(num_ranges, true);
+    on_threads(num_ranges, [&](size_t r) {
+        auto worse = [&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+            return partitions[b.first].entries[b.second] < partitions[a.first].entries[a.second];
+        };
+        // (partition, index) of the next entry of each partition
+        std::priority_queue<std::pair<size_t, size_t>, std::vector<std::pair<size_t, size_t>>,
+                            decltype(worse)>
+            heads(worse);
+        for (size_t p = 0; p != partitions.size(); p++)
+            if (starts[r][p] != starts[r + 1][p])
+                heads.push({p, starts[r][p]});
+        std::string buffer;
+        buffer.reserve(write_block + (1 << 16));
+        uint64_t offset = offsets[r];
+        while (!heads.empty() && written[r]) {
+            auto [p, i] = heads.top();
+            heads.pop();
+            append_entry(buffer, partitions[p].entries[i], format);
+            if (i + 1 != starts[r + 1][p])
+                heads.push({p, i + 1});
+            if (buffer.size() >= write_block || heads.empty()) {
+                written[r] = write_at(fd, buffer.data(), buffer.size(), offset);
+                offset += buffer.size();
+                buffer.clear();
+            }
+        }
+    });
+    for (char w : written) ok = ok && w;
+    return close(fd) == 0 && ok;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "counter_table.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* a dump is every n-gram of a count in ranked order: decreasing count, ties
+in increasing text order. As TSV it is a line `n-gram<TAB>count` per entry.
+The binary form is native byte order:
+
+    header   magic "ngd1", reserved u32 (0), number of entries (u64)
+    entries  count (u64), key length (u32), key bytes */
+enum class dump_format { tsv, binary };
+
+struct dump_header {
+    static constexpr char magic_bytes[4] = {'n', 'g', 'd', '1'};
+
+    char magic[4];
+    uint32_t reserved;
+    uint64_t num_entries;
+};
+
+struct dump_entry {
+    std::string_view key;
+    uint64_t count;
+    // the first eight bytes of the key, big-endian, so that most ties on
+    // the count are settled without touching the key
+    uint64_t prefix;
+
+    dump_entry(std::string_view key, uint64_t count) : key(key), count(count), prefix(0) {
+        for (size_t i = 0; i != 8; i++)
+            prefix = prefix << 8 | (i < key.size() ? (uint8_t) key[i] : 0);
+    }
+    bool operator<(const dump_entry& other) const {
+        if (count != other.count)
+            return count > other.count;
+        return prefix < other.prefix || (prefix == other.prefix && key < other.key);
+    }
+};
+
+/* the entries of one reducer's partition, ranked, with what their keys point
+into: the table itself, or the decoded text of its id keys */
+struct ranked_partition {
+    counter_table table;
+    std::string decoded;
+    std::vector<dump_entry> entries;
+};
+
+/* merge ranked partitions over disjoint keys into one dump, on `num_threads`
+threads. The ranking is cut into as many ranges of about equal size at
+splitters sampled from the partitions; each thread sizes its range, and once
+the offsets of all ranges are known it merges its range and writes it in
+large pwrite calls at its own offset. False if the file cannot be written. */
+bool write_dump(const fs::path& file, dump_format format,
+                const std::vector<ranked_partition>& partitions, uint32_t num_threads);
+}  // namespace wc
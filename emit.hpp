@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "counter_table.hpp"
+#include "n-gram_window.hpp"
+#include "run_stats.hpp"
+#include "tokenizer.hpp"
+#include "utf8.hpp"
+#include "vocabulary.hpp"
+
+namespace wc {
+/* the counting kernels: one pass over a text that hands every n-gram of the
+orders min_n to n to sink.add(key, hash, order), keyed by text or by packed
+word ids, and adds the words and n-grams it saw to `stats`. The words are
+those of `Tokenizer`, tokenizer or utf8_tokenizer. */
+template <class Tokenizer = tokenizer, class Sink>
+void emit_text(std::string_view text, uint32_t min_n, uint32_t n, Sink& sink,
+               thread_stats& stats) {
+    // process the text in one pass, n-grams never cross a sentence break
+    ngram_window window(min_n, n);
+    Tokenizer tok(text);
+    std::string_view word;
+    uint64_t num_words = 0, num_ngrams = 0;
+    for (;;) {
+        typename Tokenizer::token_type type = tok.next(word);
+        if (type == Tokenizer::word) {
+            uint32_t longest = window.push(word);
+            num_words++;
+            num_ngrams += longest == 0 ? 0 : longest - min_n + 1;
+            for (uint32_t order = min_n; order <= longest; order++) {
+                std::string_view key = window.key(order);
+                sink.add(key, hash_key(key), order);
+            }
+        } else if (type == Tokenizer::sentence_end) {
+            window.reset();
+        } else {
+            break;
+        }
+    }
+    stats.words += num_words;
+    stats.ngrams += num_ngrams;
+}
+
+template <class Tokenizer = tokenizer, class Sink>
+void emit_ids_generic(std::string_view text, uint32_t min_n, uint32_t n, Sink& sink,
+                      word_cache& words, thread_stats& stats) {
+    // same pass as emit_text, but every word is looked up once and the
+    // window packs ids instead of joining words
+    id_window window(min_n, n);
+    Tokenizer tok(text);
+    std::string_view word;
+    std::string folded;
+    uint64_t num_words = 0, num_ngrams = 0;
+    for (;;) {
+        typename Tokenizer::token_type type = tok.next(word);
+        if (type == Tokenizer::word) {
+            folded.clear();
+            append_folded(folded, word);
+            uint32_t longest = window.push(words.id(folded));
+            num_words++;
+            num_ngrams += longest == 0 ? 0 : longest - min_n + 1;
+            for (uint32_t order = min_n; order <= longest; order++) {
+                std::string_view key = window.key(order);
+                sink.add(key, hash_ids(key), order);
+            }
+        } else if (type == Tokenizer::sentence_end) {
+            window.reset();
+        } else {
+            break;
+        }
+    }
+    stats.words += num_words;
+    stats.ngrams += num_ngrams;
+}
+
+namespace detail {
+template <uint32_t N, class Sink, uint32_t... K>
+void emit_orders(const fixed_id_window<N>& window, uint32_t min_n, uint32_t longest,
+                 Sink& sink, std::integer_sequence<uint32_t, K...>) {
+    // one statement per order, each with its key length and hash fixed
+    ((K + 1 >= min_n && K + 1 <= longest
+          ? sink.add(window.template key<K + 1>(),
+                     hash_ids<K + 1>(window.template last<K + 1>()), K + 1)
+          : void()),
+     ...);
+}
+}  // namespace detail
+
+// emit_ids_generic with n fixed at compile time, through a fixed_id_window
+template <uint32_t N, class Tokenizer = tokenizer, class Sink>
+void emit_ids_fixed(std::string_view text, uint32_t min_n, Sink& sink, word_cache& words,
+                    thread_stats& stats) {
+    fixed_id_window<N> window;
+    Tokenizer tok(text);
+    std::string_view word;
+    std::string folded;
+    uint64_t num_words = 0, num_ngrams = 0;
+    for (;;) {
+        typename Tokenizer::token_type type = tok.next(word);
+        if (type == Tokenizer::word) {
+            folded.clear();
+            append_folded(folded, word);
+            uint32_t longest = window.push(words.id(folded));
+            num_words++;
+            if (longest < min_n)
+                continue;
+            num_ngrams += longest - min_n + 1;
+            detail::emit_orders(window, min_n, longest, sink,
+                                std::make_integer_sequence<uint32_t, N>{});
+        } else if (type == Tokenizer::sentence_end) {
+            window.reset();
+        } else {
+            break;
+        }
+    }
+    stats.words += num_words;
+    stats.ngrams += num_ngrams;
+}
+
+// the id kernel for n: a fixed one for the common orders, else the generic
+template <class Tokenizer = tokenizer, class Sink>
+void emit_ids(std::string_view text, uint32_t min_n, uint32_t n, Sink& sink,
+              word_cache& words, thread_stats& stats) {
+    switch (n) {
+        case 1:
+            return emit_ids_fixed<1, Tokenizer>(text, min_n, sink, words, stats);
+        case 2:
+            return emit_ids_fixed<2, Tokenizer>(text, min_n, sink, words, stats);
+        case 3:
+            return emit_ids_fixed<3, Tokenizer>(text, min_n, sink, words, stats);
+        case 4:
+            return emit_ids_fixed<4, Tokenizer>(text, min_n, sink, words, stats);
+        default:
+            return emit_ids_generic<Tokenizer>(text, min_n, n, sink, words, stats);
+    }
+}
+}  // namespace wc
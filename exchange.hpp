@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace wc {
+/* the shuffle between mappers and reducers: one mailbox per partition, to
+which every mapper sends exactly one piece. A reducer blocks on its mailbox
+and takes the pieces in the order they arrive, so it can start merging while
+slower mappers are still working, and sleeps instead of polling. */
+template <class T>
+class exchange {
+    struct alignas(64) mailbox {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<T> arrived;
+        uint32_t taken = 0;
+    };
+    uint32_t num_senders;
+    std::vector<mailbox> mailboxes;
+
+   public:
+    exchange(uint32_t num_partitions, uint32_t num_senders)
+        : num_senders(num_senders), mailboxes(num_partitions) {}
+
+    void send(uint32_t partition, T piece) {
+        mailbox& box = mailboxes[partition];
+        std::lock_guard<std::mutex> lock(box.mtx);
+        box.arrived.push_back(std::move(piece));
+        box.cv.notify_one();
+    }
+
+    // wait for the next piece of `partition`; false once all have been taken
+    bool receive(uint32_t partition, T& piece) {
+        mailbox& box = mailboxes[partition];
+        std::unique_lock<std::mutex> lock(box.mtx);
+        if (box.taken == num_senders)
+            return false;
+        box.cv.wait(lock, [&box] { return !box.arrived.empty(); });
+        piece = std::move(box.arrived.back());
+        box.arrived.pop_back();
+        box.taken++;
+        return true;
+    }
+};
+}  // namespace wc
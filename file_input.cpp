@@ -0,0 +1,136 @@
+#include "file_input.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "tokenizer.hpp"
+
+namespace {
+const size_t overrun_block = 1 << 16;
+
+// position of the first sentence break in [from, text.size()), or npos
+size_t find_break(std::string_view text, size_t from) {
+    for (size_t i = from; i < text.size(); i++)
+        if (wc::classify(text[i]) == wc::char_class::sentence_break)
+            return i;
+    return std::string_view::npos;
+}
+
+// first byte of the first sentence starting at or after `offset`, where
+// `text` begins at file position `base`; npos if there is none in `text`
+size_t first_sentence(std::string_view text, uint64_t base, uint64_t offset) {
+    if (offset == 0)
+        return 0;
+    size_t pos = find_break(text, offset - 1 - base);
+    return pos == std::string_view::npos ? pos : pos + 1;
+}
+
+uint64_t range_end(const wc::work_item& item, uint64_t size) {
+    return item.length >= size - std::min(item.offset, size)
+               ? size
+               : item.offset + item.length;
+}
+}  // namespace
+
+wc::file_input::file_input(const work_item& item, io_mode mode) {
+    if (mode == io_mode::mmap && map(item))
+        return;
+    read_stream(item);
+}
+
+wc::file_input::file_input(const work_item& item, std::string_view bytes,
+                           uint64_t base, uint64_t file_size) {
+    uint64_t end = range_end(item, file_size);
+    if (item.offset >= end)
+        return;
+    if (base + bytes.size() < end) {
+        read_stream(item);
+        return;
+    }
+    size_t begin = first_sentence(bytes, base, item.offset);
+    if (begin == std::string_view::npos || base + begin >= end)
+        return;
+    size_t stop = find_break(bytes, std::max<size_t>(begin, end - 1 - base));
+    if (stop == std::string_view::npos) {
+        if (base + bytes.size() < file_size) {
+            read_stream(item);
+            return;
+        }
+        stop = bytes.size();
+    }
+    contents = bytes.substr(begin, stop - begin);
+}
+
+wc::file_input::~file_input() {
+    if (mapping != nullptr)
+        munmap(mapping, mapped_size);
+}
+
+void wc::file_input::read_stream(const work_item& item) {
+    std::ifstream fin(item.path, std::ios::binary | std::ios::ate);
+    if (!fin)
+        return;
+    uint64_t size = fin.tellg();
+    uint64_t end = range_end(item, size);
+    if (item.offset >= end)
+        return;
+    // read one byte before the range to see whether a sentence starts on it
+    uint64_t base = item.offset == 0 ? 0 : item.offset - 1;
+    buffer.resize(end - base);
+    fin.seekg(base);
+    fin.read(buffer.data(), buffer.size());
+    size_t begin = first_sentence(buffer, base, item.offset);
+    if (begin == std::string_view::npos || base + begin >= end)
+        return;
+    // finish the last sentence, which may run past the end of the range
+    size_t stop = find_break(buffer, std::max<size_t>(begin, end - 1 - base));
+    while (stop == std::string_view::npos && base + buffer.size() < size) {
+        size_t old_size = buffer.size();
+        size_t more = std::min<uint64_t>(overrun_block, size - base - old_size);
+        buffer.resize(old_size + more);
+        fin.read(buffer.data() + old_size, more);
+        stop = find_break(buffer, old_size);
+    }
+    if (stop == std::string_view::npos)
+        stop = buffer.size();
+    contents = std::string_view(buffer).substr(begin, stop - begin);
+}
+
+bool wc::file_input::map(const work_item& item) {
+    int fd = open(item.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    uint64_t end = range_end(item, st.st_size);
+    if (item.offset >= end) {
+        // nothing to map, the view stays empty
+        close(fd);
+        return true;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    mapping = addr;
+    mapped_size = st.st_size;
+    std::string_view file(static_cast<const char*>(addr), mapped_size);
+    size_t begin = first_sentence(file.substr(0, end), 0, item.offset);
+    if (begin == std::string_view::npos || begin >= end)
+        return true;
+    size_t page = begin - begin % sysconf(_SC_PAGESIZE);
+    madvise(static_cast<char*>(addr) + page, end - page, MADV_SEQUENTIAL);
+    size_t stop = find_break(file, std::max<size_t>(begin, end - 1));
+    if (stop == std::string_view::npos)
+        stop = file.size();
+    contents = file.substr(begin, stop - begin);
+    return true;
+}
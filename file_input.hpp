@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+namespace wc {
+// how a mapper gets at the bytes of a file
+enum class io_mode {
+    stream,
+    mmap,
+    // a read-ahead stage fills buffers for the mappers through io_uring,
+    // or a pool of threads calling pread if the kernel does not allow it
+    uring,
+    // the same stage, always with the thread pool
+    threads
+};
+
+/* a unit of map work: the sentences of `path` that start inside
+[offset, offset + length). A sentence starting in the range is read to its
+end even if that lies past the range, and one starting before it is left to
+the previous chunk, so splitting a file never cuts an n-gram in half. */
+struct work_item {
+    static constexpr uint64_t whole_file = std::numeric_limits<uint64_t>::max();
+
+    fs::path path;
+    uint64_t offset = 0;
+    uint64_t length = whole_file;
+    // bytes the item is expected to read, used to balance the threads
+    uint64_t cost = 0;
+};
+
+/* read-only view of the text of one work item. In stream mode the bytes are
+read into a single heap buffer, bounded by the item length plus the tail of
+its last sentence; in mmap mode the view points straight into the page cache
+and nothing is copied. A file that cannot be opened reads as empty. */
+class file_input {
+    std::string buffer;
+    void* mapping = nullptr;
+    size_t mapped_size = 0;
+    std::string_view contents;
+
+    void read_stream(const work_item& item);
+    bool map(const work_item& item);
+
+   public:
+    file_input(const work_item& item, io_mode mode);
+    /* view the item inside `bytes`, the contents of the file from `base` on as
+    read ahead by someone else. Reads the item itself if they end before its
+    last sentence does. */
+    file_input(const work_item& item, std::string_view bytes, uint64_t base,
+               uint64_t file_size);
+    ~file_input();
+    file_input(const file_input&) = delete;
+    file_input& operator=(const file_input&) = delete;
+
+    std::string_view text() const { return contents; }
+};
+}  // namespace wc
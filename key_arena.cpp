@@ -0,0 +1,35 @@
+#include "key_arena.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+char* wc::key_arena::grow(size_t size) {
+    if (size > next_block / 4) {
+        // oversized keys get a block of their own, the current one stays open
+        blocks.emplace_back(new char[size]);
+        allocated += size;
+        return blocks.back().get();
+    }
+    blocks.emplace_back(new char[next_block]);
+    allocated += next_block;
+    cur = blocks.back().get();
+    left = next_block;
+    next_block = std::min(next_block * 2, max_block);
+    return cur;
+}
+
+void wc::key_arena::adopt(key_arena&& other) {
+    blocks.insert(blocks.end(), std::make_move_iterator(other.blocks.begin()),
+                  std::make_move_iterator(other.blocks.end()));
+    allocated += other.allocated;
+    other.blocks.clear();
+    other.clear();
+}
+
+void wc::key_arena::clear() {
+    blocks.clear();
+    cur = nullptr;
+    left = 0;
+    next_block = min_block;
+    allocated = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace wc {
+/* bump allocator owning the key bytes of one counter_table. Keys are
+appended to large blocks that never move, so a stored key stays valid for as
+long as the arena (or whichever arena adopted its blocks) lives. */
+class key_arena {
+    static constexpr size_t min_block = 1 << 12;
+    static constexpr size_t max_block = 1 << 20;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cur = nullptr;
+    size_t left = 0;
+    size_t next_block = min_block;
+    size_t allocated = 0;
+
+    char* grow(size_t size);
+
+   public:
+    // copy `key` into the arena and return where it now lives
+    const char* store(std::string_view key) {
+        char* dest = key.size() <= left ? cur : grow(key.size());
+        std::copy(key.begin(), key.end(), dest);
+        if (dest == cur) {
+            cur += key.size();
+            left -= key.size();
+        }
+        return dest;
+    }
+
+    // take over every block of `other`, keys stored there stay where they are
+    void adopt(key_arena&& other);
+    void clear();
+    // bytes held by the blocks
+    size_t memory_bytes() const { return allocated; }
+};
+}  // namespace wc
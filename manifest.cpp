@@ -0,0 +1,67 @@
+#include "manifest.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace {
+const char* const magic = "ngc-manifest 1";
+}
+
+wc::manifest wc::manifest::load(const fs::path& file) {
+    manifest result;
+    std::ifstream in(file);
+    std::string line;
+    if (!std::getline(in, line) || line != magic)
+        return result;
+    std::string word;
+    manifest parsed;
+    if (!(in >> word >> parsed.min_n >> parsed.n) || word != "orders" || !(in >> word))
+        return result;
+    if (word == "text") {
+        std::string mode;
+        if (!(in >> mode >> word))
+            return result;
+        parsed.utf8 = mode == "utf8";
+    }
+    if (word != "next" || !(in >> parsed.next_segment))
+        return result;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        file_entry entry;
+        if (!(fields >> entry.segment >> entry.size >> entry.mtime >> std::hex >>
+              entry.hash))
+            return result;
+        // the path is the rest of the line after one tab
+        fields.get();
+        std::string path;
+        std::getline(fields, path);
+        parsed.files[path] = entry;
+    }
+    return parsed;
+}
+
+bool wc::manifest::save(const fs::path& file) const {
+    fs::path temporary = file;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << magic << "\n"
+            << "orders " << min_n << " " << n << "\n"
+            << (utf8 ? "text utf8\n" : "")
+            << "next " << next_segment << "\n";
+        for (const auto& [path, entry] : files)
+            out << entry.segment << "\t" << entry.size << "\t" << entry.mtime << "\t"
+                << std::hex << entry.hash << std::dec << "\t" << path << "\n";
+        out.close();
+        if (out.fail())
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(temporary, file, ec);
+    return !ec;
+}
+
+fs::path wc::segment_dir(const fs::path& dir, uint32_t segment) {
+    return dir / ("seg-" + std::to_string(segment));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* what an incremental store was built from. Every run counts the files it
+maps into a segment of its own; a file is recorded with its size, modification
+time and content hash, and the segment that holds its counts. A text file,
+one file per line, the path last. */
+struct manifest {
+    struct file_entry {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t hash = 0;
+        uint32_t segment = 0;
+    };
+
+    // the orders the segments were counted with
+    uint32_t min_n = 0;
+    uint32_t n = 0;
+    // whether they split words as UTF-8, a line of its own when they did
+    bool utf8 = false;
+    uint32_t next_segment = 0;
+    std::map<std::string, file_entry> files;
+
+    // an empty manifest if `file` is missing or unreadable
+    static manifest load(const fs::path& file);
+    // write to a temporary file and rename it over `file`
+    bool save(const fs::path& file) const;
+};
+
+// the directory holding the counts of one segment of a store
+fs::path segment_dir(const fs::path& dir, uint32_t segment);
+}  // namespace wc
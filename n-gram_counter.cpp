@@ -2,171 +2,1013 @@
 
 #include <algorithm>
 #include <atomic>
-#include <fstream>
-#include <future>
+#include <charconv>
+#include <functional>
 #include <iostream>
-#include <mutex>
-#include <queue>
-#include <regex>
 #include <thread>
 #include <vector>
 
+#include "count_store.hpp"
+#include "emit.hpp"
+#include "exchange.hpp"
+#include "manifest.hpp"
+#include "n-gram_window.hpp"
+#include "placement.hpp"
+#include "result_cache.hpp"
+#include "scheduler.hpp"
+#include "sketch.hpp"
+#include "store_merge.hpp"
+#include "tokenizer.hpp"
 #include "utils.hpp"
 
+namespace {
+// entries of each order a cache keeps, so that smaller -k are answered too
+const uint32_t cached_top_k = 100;
+
+uint64_t default_chunk_size(const wc::options& opts) {
+    if (opts.chunk_size != 0)
+        return opts.chunk_size;
+    // a read-ahead buffer holds a chunk with room for its last sentence
+    if (opts.io == wc::io_mode::uring || opts.io == wc::io_mode::threads)
+        return opts.io_buffer_size / 2;
+    // spilling is checked between work items, chunks keep them small
+    return opts.memory_budget != 0 ? 16 << 20 : 0;
+}
+
+wc::options legacy_options(uint32_t n, uint32_t num_threads) {
+    wc::options opts;
+    opts.n = n;
+    opts.num_threads = num_threads;
+    return opts;
+}
+}  // namespace
+
 wc::wordCounter::wordCounter(const std::string& dir, uint32_t n,
                              uint32_t num_threads)
-    : dir(dir), n(n), num_threads(num_threads) {}
+    : wordCounter(dir, legacy_options(n, num_threads)) {}
 
-void wc::wordCounter::process() {
-    std::vector<std::vector<std::promise<fmap>>> promises;
-    for (uint32_t i = 0; i != num_threads; i++)
-        promises.push_back(std::vector<std::promise<fmap>>(num_threads));
+wc::wordCounter::wordCounter(const std::string& dir, const options& opts)
+    : dir(dir),
+      min_n(lowest_order(opts)),
+      n(opts.n),
+      num_threads(opts.num_threads),
+      extensions(opts.extensions),
+      io(opts.io),
+      io_depth(std::max<uint32_t>(opts.io_depth, 1)),
+      io_buffers(opts.io_buffers == 0 ? io_depth + 2 * opts.num_threads : opts.io_buffers),
+      io_buffer_size(opts.io_buffer_size),
+      chunk_size(default_chunk_size(opts)),
+      // ids are private to a node, a cluster ships its n-grams as text
+      keys(opts.cluster.empty() ? opts.keys : key_mode::text),
+      text(opts.text),
+      scheduler_stats(opts.scheduler_stats),
+      stats_json(opts.stats_json),
+      trace_file(opts.trace_file),
+      top_k(opts.top_k),
+      output_dir(opts.output_dir),
+      dump_file(opts.dump_file),
+      dump_as(opts.dump_as),
+      incremental(opts.incremental),
+      segment_size(std::max<uint64_t>(opts.segment_size, 1)),
+      cache_dir(opts.cache_dir),
+      memory_budget(opts.memory_budget),
+      spill_dir(opts.spill_dir.empty() ? fs::temp_directory_path().string()
+                                       : opts.spill_dir),
+      scanners(opts.scanners == 0 ? opts.num_threads : opts.scanners),
+      numa(opts.numa),
+      approximate(opts.approximate),
+      sketch_width(opts.sketch_width),
+      cluster_nodes(opts.cluster),
+      rank(opts.rank) {}
 
-    std::vector<std::vector<std::future<fmap>>> futures(num_threads);
-    for (uint32_t i = 0; i != num_threads; i++) {
-        for (uint32_t j = 0; j != num_threads; j++)
-            futures[i].push_back(promises[j][i].get_future());
+namespace {
+void largest_first(std::vector<wc::work_item>& items) {
+    std::sort(items.begin(), items.end(), [](const wc::work_item& a, const wc::work_item& b) {
+        return a.cost > b.cost;
+    });
+}
+
+void largest_files_first(std::vector<std::pair<fs::path, wc::manifest::file_entry>>& files) {
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+        return a.second.size > b.second.size;
+    });
+}
+
+// sends every n-gram to the table of the reducer owning it
+struct partition_sink {
+    std::vector<wc::fmap>& partitions;
+
+    void add(std::string_view key, uint64_t hash, uint32_t) {
+        partitions[wc::partition_of(hash, partitions.size())].add(key, hash);
+    }
+};
+
+// feeds every n-gram to a sketch of all orders and a summary of its own order
+struct sketch_sink {
+    wc::count_min_sketch& sketch;
+    std::vector<wc::heavy_hitters>& summaries;
+    uint32_t min_n;
+
+    void add(std::string_view key, uint64_t hash, uint32_t order) {
+        summaries[order - min_n].offer(key, hash, sketch.add(hash));
+    }
+};
+}  // namespace
+
+std::vector<std::vector<wc::ranked_entry>> wc::wordCounter::run(bool* readable) {
+    // the scanners feed the workers as they go, except for an incremental
+    // count, which needs the whole list to compare with its manifest
+    work_source discover = [this](scheduler& sched) { return discover_work(sched); };
+    bool found = true;
+    std::vector<std::vector<count_t>> tops;
+    if (!cluster_nodes.empty()) {
+        tops = count_cluster(&found);
+    } else if (!cache_dir.empty()) {
+        tops = count_cached(&found);
+    } else if (approximate) {
+        tops = count_approx(discover, &found);
+    } else if (incremental) {
+        std::vector<fs::path> files =
+            utils::find_all_files(dir, input_filter(), scanners, &found);
+        // a corpus that cannot be read would drop every segment of the store
+        tops = found ? count_incremental(std::move(files), output_dir, top_k)
+                     : std::vector<std::vector<count_t>>(n - min_n + 1);
+    } else {
+        tops = count(discover, output_dir, nullptr, &found);
     }
+    if (!found)
+        std::cerr << " * cannot read " << dir.string() << std::endl;
+    if (readable)
+        *readable = found;
+    return tops;
+}
 
-    std::vector<fs::path> all_files = utils::find_all_files(
-        dir, [](const std::string& extension) { return extension == ".txt"; });
+bool wc::wordCounter::process() {
+    bool readable = true;
+    std::vector<std::vector<count_t>> tops = run(&readable);
+    if (!readable)
+        return false;
+    // the first node of a cluster prints for all of them
+    if (!cluster_nodes.empty() && rank != 0)
+        return true;
 
-    // map each file to a thread
-    std::vector<std::vector<fs::path>> files_to_sweep(num_threads);
-    for (uint32_t i = 0; i < all_files.size(); i++)
-        files_to_sweep[i % num_threads].push_back(all_files[i]);
+    // display
+    for (uint32_t order = min_n; order <= n; order++) {
+        std::cout << " * =================================== Top " << top_k
+                  << " " << order << "-grams" << (approximate ? " (estimated)" : "")
+                  << std::endl;
+        for (const count_t& entry : tops[order - min_n])
+            std::cout << " | " << entry.first << ": " << entry.second << std::endl;
+        std::cout << " * --------------------------------------------- " << std::endl;
+    }
+    return true;
+}
 
-    std::mutex wc_mtx;
-    std::atomic<uint32_t> display_id = 0;
-    std::condition_variable cv;
-    auto sweep = [this, &wc_mtx, &display_id, &cv](
-                     uint32_t thread_id, std::vector<fs::path>&& files,
-                     std::vector<std::promise<fmap>>&& my_promises,
-                     std::vector<std::future<fmap>>&& my_futures) {
-        fmap local_freq;
-        for (fs::path file : files) {
-            process_file(file, local_freq);
+std::vector<std::vector<wc::wordCounter::count_t>> wc::wordCounter::count(
+    const work_source& source, const fs::path& store_dir, cluster* nodes, bool* readable) {
+    scheduler sched(num_threads);
+    // the workers, then the feeder
+    run_stats stats(num_threads + 1, !trace_file.empty());
+    bool found = true;
+    std::thread feeder(&wordCounter::feed, this, std::cref(source), std::ref(sched),
+                       std::ref(stats), std::ref(found));
+    std::unique_ptr<read_ahead> ahead = start_reading(sched);
+
+    // every thread sends one piece of each partition to its reducer, and so
+    // does every other node of a cluster. Partitions are numbered across the
+    // nodes, reducer r of node i owns partition i * num_threads + r
+    uint32_t num_nodes = nodes == nullptr ? 1 : nodes->size();
+    uint32_t my_node = nodes == nullptr ? 0 : nodes->rank();
+    exchange<shuffle_piece> shuffle(num_threads, num_threads + num_nodes - 1);
+    vocabulary vocab;
+    std::atomic<uint32_t> mapped = 0;
+
+    // the top k of each order, per reducer
+    std::vector<std::vector<std::vector<count_t>>> local_tops(num_threads);
+    std::vector<char> written(num_threads, true);
+    if (!store_dir.empty())
+        fs::create_directories(store_dir);
+    // under a memory budget every thread spills sorted runs of its tables
+    // once they outgrow its share, and its reducer merges them at the end
+    uint64_t share = memory_budget / num_threads;
+    std::unique_ptr<spill_area> spills;
+    if (memory_budget != 0)
+        spills = std::make_unique<spill_area>(spill_dir, num_threads);
+    std::vector<std::thread> receivers;
+    for (uint32_t node = 0; node != num_nodes; node++) {
+        if (node != my_node)
+            receivers.push_back(std::thread([this, nodes, node, &sched, &shuffle, &spills, share] {
+                receive_pieces(*nodes, node, sched, shuffle, spills.get(), share);
+            }));
+    }
+    std::vector<ranked_partition> ranked(dump_file.empty() ? 0 : num_threads);
+    std::unique_ptr<thread_placement> placement;
+    if (numa)
+        placement = std::make_unique<thread_placement>();
+    auto sweep = [this, &sched, &shuffle, &vocab, &local_tops, &written, &store_dir,
+                  share, &spills, &ahead, nodes, num_nodes, my_node, &mapped, &stats,
+                  &placement, &ranked](uint32_t thread_id) {
+        // a thread maps and then reduces on the same CPU, so its tables are
+        // filled on the node they were first touched on
+        uint32_t my_numa_node = shuffle_piece::no_node;
+        if (placement && placement->pin(thread_id, num_threads))
+            my_numa_node = placement->node_of(thread_id, num_threads);
+        thread_stats& my_stats = stats.thread(thread_id);
+        // map straight into one table per reducer, so there is no group by
+        std::vector<fmap> subsets(num_nodes * num_threads);
+        partition_sink sink{subsets};
+        word_cache words(vocab);
+        for_each_text(thread_id, sched, ahead.get(), stats, [&](std::string_view text) {
+            process_text(text, sink, words, my_stats);
+            if (!spills)
+                return;
+            // this node's partitions are spilled to runs of their reducers,
+            // the rest is sent to its node ahead of the shuffle
+            fmap* mine = &subsets[my_node * num_threads];
+            size_t bytes = 0;
+            for (uint32_t i = 0; i != num_threads; i++) bytes += spill_footprint(mine[i]);
+            if (bytes > share) {
+                for (uint32_t i = 0; i != num_threads; i++)
+                    if (!mine[i].empty())
+                        spills->spill(i, mine[i]);
+            }
+            if (num_nodes == 1)
+                return;
+            bytes = 0;
+            for (uint32_t i = 0; i != subsets.size(); i++)
+                if (i / num_threads != my_node)
+                    bytes += spill_footprint(subsets[i]);
+            if (bytes > share) {
+                for (uint32_t i = 0; i != subsets.size(); i++) {
+                    if (i / num_threads == my_node || subsets[i].empty())
+                        continue;
+                    send_entries(nodes->peer(i / num_threads), i % num_threads, subsets[i]);
+                    subsets[i].clear();
+                }
+            }
+        });
+
+        // shuffle, pieces for other nodes are sent over and dropped
+        lap_timer timer(stats, thread_id);
+        for (const fmap& subset : subsets) my_stats.table_rehashes += subset.rehashes();
+        for (uint32_t i = 0; i != subsets.size(); i++) {
+            if (i / num_threads == my_node) {
+                shuffle.send(i % num_threads, {std::move(subsets[i]), my_numa_node});
+            } else {
+                send_entries(nodes->peer(i / num_threads), i % num_threads, subsets[i]);
+                fmap().swap(subsets[i]);
+            }
         }
+        if (nodes != nullptr && ++mapped == num_threads) {
+            for (uint32_t node = 0; node != num_nodes; node++)
+                if (node != my_node)
+                    nodes->peer(node).send(link::entries_done, {});
+        }
+        timer.lap(phase::shuffle);
 
-        // group by
-        std::vector<fmap> subsets(num_threads);
-        for (const auto& [word, count] : local_freq) {
-            size_t target_thread = std::hash<std::string>{}(word) % num_threads;
-            subsets[target_thread][word] = count;
+        // reduce, merging the pieces in whatever order they arrive. The
+        // entries of the smaller table are always moved into the larger one,
+        // but when threads are pinned only pieces filled on the reducer's own
+        // node are: the others are copied, so the table stays node-local
+        fmap final_map;
+        shuffle_piece piece;
+        while (shuffle.receive(thread_id, piece)) {
+            timer.lap(phase::reduce_wait);
+            if (placement && (piece.node != my_numa_node || piece.node == shuffle_piece::no_node))
+                final_map.absorb(piece.table);
+            else
+                final_map.merge(std::move(piece.table));
+            if (spills && spill_footprint(final_map) > share)
+                spills->spill(thread_id, final_map);
+            timer.lap(phase::reduce);
         }
+        timer.lap(phase::reduce_wait);
+        my_stats.table_rehashes += final_map.rehashes();
 
-        // shuffle
-        for (uint32_t i = 0; i != num_threads; i++) {
-            my_promises[i].set_value(subsets[i]);
+        // every mapper has spilled before sending its last piece, what is
+        // left of the reduced table joins their runs
+        std::vector<fs::path> runs = spills ? spills->runs(thread_id) : std::vector<fs::path>();
+        if (!runs.empty()) {
+            if (!final_map.empty())
+                runs.push_back(spills->spill(thread_id, final_map));
+            written[thread_id] = reduce_runs(runs, store_dir, thread_id, vocab, *spills,
+                                             local_tops[thread_id]);
+            timer.lap(phase::reduce);
+            return;
         }
 
-        // reduce
-        fmap final_map;
-        std::queue<std::future<fmap>> futures_queue;
-        for (auto& fut : my_futures) {
-            futures_queue.push(std::move(fut));
-        }
-        while (!futures_queue.empty()) {
-            std::future<fmap>& front_future = futures_queue.front();
-            if (front_future.wait_for(std::chrono::seconds(0)) ==
-                std::future_status::ready) {
-                fmap my_fmap = front_future.get();
-                for (auto& p : my_fmap) final_map[p.first] += p.second;
-                futures_queue.pop();
-            } else {
-                futures_queue.push(std::move(front_future));
-                futures_queue.pop();
+        // select, the vocabulary is complete: every mapper has sent its
+        // pieces
+        my_stats.distinct_keys = final_map.size();
+        for (uint32_t order = min_n; order <= n; order++)
+            local_tops[thread_id].push_back(top_entries(final_map, order, vocab));
+        timer.lap(phase::select);
+
+        // every reducer writes a file of its own, there is nothing to share
+        if (!store_dir.empty()) {
+            written[thread_id] =
+                write_partition(final_map, store_dir, thread_id, vocab);
+            timer.lap(phase::write);
+        }
+        // a dump ranks every partition here, in parallel, and merges them
+        // once all are done
+        if (!dump_file.empty()) {
+            rank_partition(std::move(final_map), vocab, ranked[thread_id]);
+            timer.lap(phase::select);
+        }
+    };
+    // start all threads and wait for them to finish
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < num_threads; ++i)
+        workers.push_back(std::thread(sweep, i));
+    for (auto& worker : workers) worker.join();
+    feeder.join();
+    if (readable)
+        *readable = found;
+    for (auto& receiver : receivers) receiver.join();
+
+    if (!store_dir.empty())
+        remove_stale_partitions(store_dir, num_threads);
+    if (!dump_file.empty()) {
+        lap_timer timer(stats, num_threads);
+        if (!write_dump(dump_file, dump_as, ranked, num_threads))
+            std::cerr << " * cannot write " << dump_file.string() << std::endl;
+        timer.lap(phase::write);
+        ranked.clear();
+    }
+    for (uint32_t i = 0; i != num_threads; i++) {
+        if (!written[i])
+            std::cerr << " * cannot write " << store_file(store_dir, i).string()
+                      << std::endl;
+    }
+
+    print_scheduler_stats(sched);
+    report_stats(stats, sched);
+
+    // partitions hold disjoint keys, so the global top k is among the local
+    // ones and a k-way merge of the sorted lists finds it
+    std::vector<std::vector<count_t>> tops;
+    for (uint32_t order = min_n; order <= n; order++) {
+        std::vector<std::vector<count_t>> lists;
+        for (auto& local : local_tops) lists.push_back(std::move(local[order - min_n]));
+        tops.push_back(merge_top(std::move(lists), top_k));
+    }
+    if (nodes == nullptr)
+        return tops;
+    if (my_node != 0) {
+        nodes->peer(0).send(link::tops, encode_tops(tops));
+        return tops;
+    }
+    // the nodes own disjoint partitions too
+    std::vector<std::vector<std::vector<count_t>>> node_tops{std::move(tops)};
+    for (uint32_t node = 1; node != num_nodes; node++) {
+        link::message_type type;
+        std::string payload;
+        std::vector<std::vector<count_t>> theirs;
+        if (!nodes->peer(node).receive(type, payload) || type != link::tops ||
+            !decode_tops(payload, theirs) || theirs.size() != n - min_n + 1) {
+            std::cerr << " * cluster: lost node " << node << std::endl;
+            std::exit(1);
+        }
+        node_tops.push_back(std::move(theirs));
+    }
+    tops.clear();
+    for (uint32_t order = min_n; order <= n; order++) {
+        std::vector<std::vector<count_t>> lists;
+        for (auto& local : node_tops) lists.push_back(std::move(local[order - min_n]));
+        tops.push_back(merge_top(std::move(lists), top_k));
+    }
+    return tops;
+}
+
+std::vector<std::vector<wc::wordCounter::count_t>> wc::wordCounter::count_cluster(
+    bool* readable) {
+    // what a partition is and how much of it is sent back depend on these,
+    // every node must agree on them
+    std::string settings = "n=" + std::to_string(min_n) + ".." + std::to_string(n) +
+                           (text == text_mode::utf8 ? " utf8" : "") +
+                           " t=" + std::to_string(num_threads) + " k=" + std::to_string(top_k);
+    cluster nodes(cluster_nodes, rank, settings);
+    work_source fetch = [this, &nodes](scheduler& sched) {
+        if (nodes.rank() != 0) {
+            // the answers are pushed by the receiver of the first node's link
+            nodes.peer(0).send(link::work_request, {});
+            return true;
+        }
+        bool found = true;
+        std::vector<work_item> items =
+            plan_work(utils::find_all_files(dir, input_filter(), scanners, &found));
+        largest_first(items);
+        nodes.hand_out(std::move(items));
+        // the coordinator takes batches of the work like any other node
+        for (uint32_t turn = 0;; sched.wait_below(num_threads)) {
+            std::vector<work_item> batch = nodes.take_work(num_threads);
+            if (batch.empty())
+                break;
+            for (work_item& item : batch) sched.push(turn++ % num_threads, std::move(item));
+        }
+        sched.close();
+        return found;
+    };
+    return count(fetch, "", &nodes, readable);
+}
+
+void wc::wordCounter::receive_pieces(cluster& nodes, uint32_t node, scheduler& sched,
+                                     exchange<shuffle_piece>& shuffle, spill_area* spills,
+                                     uint64_t share) const {
+    link& from = nodes.peer(node);
+    std::vector<fmap> pieces(num_threads);
+    // on the other nodes, the first node's link also brings their work
+    bool fetching = nodes.rank() != 0 && node == 0;
+    bool done = false;
+    uint32_t turn = 0;
+    link::message_type type;
+    std::string payload;
+    while (!done || fetching) {
+        bool ok = from.receive(type, payload);
+        std::vector<work_item> items;
+        if (ok && type == link::work_request) {
+            from.send(link::work_items, encode_items(nodes.take_work(num_threads)));
+        } else if (ok && type == link::work_items && decode_items(payload, items)) {
+            if (items.empty()) {
+                sched.close();
+                fetching = false;
+                continue;
             }
+            for (work_item& item : items) sched.push(turn++ % num_threads, std::move(item));
+            sched.wait_below(num_threads);
+            from.send(link::work_request, {});
+        } else if (ok && type == link::entries) {
+            ok = add_entries(payload, pieces);
+            size_t bytes = 0;
+            for (const fmap& piece : pieces) bytes += spill_footprint(piece);
+            if (ok && spills != nullptr && bytes > share) {
+                for (uint32_t i = 0; i != num_threads; i++)
+                    if (!pieces[i].empty())
+                        spills->spill(i, pieces[i]);
+            }
+        } else if (ok && type == link::entries_done) {
+            done = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << " * cluster: lost node " << node << std::endl;
+            std::exit(1);
         }
+    }
+    // everything the node counted for each reducer is one piece
+    for (uint32_t i = 0; i != num_threads; i++) shuffle.send(i, {std::move(pieces[i])});
+}
 
-        // sorting
-        using pair_t = std::pair<std::string, uint64_t>;
-        std::vector<pair_t> freq_vec(final_map.size());
-        uint32_t index = 0;
-        for (auto [word, cnt] : final_map) {
-            freq_vec[index++] = {word, cnt};
-        }
-        std::sort(freq_vec.begin(), freq_vec.end(),
-                  [](const pair_t& p1, const pair_t& p2) {
-                      // decreasing order, of course
-                      return p1.second > p2.second ||
-                             (p1.second == p2.second && p1.first < p2.first);
-                  });
-
-        // display
-        std::unique_lock<std::mutex> lock(wc_mtx);
-        while (display_id.load() != thread_id) cv.wait(lock);
-        std::cout << " * =================================== Thread "
-                  << thread_id << std::endl;
-        for (size_t i = 0; i != freq_vec.size() && i != header; i++)
-            std::cout << " | " << freq_vec[i].first << ": "
-                      << freq_vec[i].second << std::endl;
-        std::cout << " * --------------------------------------------- "
-                  << std::endl;
-        display_id++;
-        cv.notify_one();
+std::vector<std::vector<wc::wordCounter::count_t>> wc::wordCounter::count_approx(
+    const work_source& source, bool* readable) {
+    scheduler sched(num_threads);
+    run_stats stats(num_threads + 1, !trace_file.empty());
+    bool found = true;
+    std::thread feeder(&wordCounter::feed, this, std::cref(source), std::ref(sched),
+                       std::ref(stats), std::ref(found));
+    std::unique_ptr<read_ahead> ahead = start_reading(sched);
+    vocabulary vocab;
+
+    // a fixed amount of memory per thread, however many distinct n-grams
+    // there are: one sketch for every order and a heavy-hitter summary each
+    size_t summary_size = std::max<size_t>(1 << 16, 16 * size_t(top_k));
+    std::vector<count_min_sketch> sketches(num_threads,
+                                           count_min_sketch(sketch_width, sketch_depth));
+    std::vector<std::vector<heavy_hitters>> summaries(
+        num_threads, std::vector<heavy_hitters>(n - min_n + 1, heavy_hitters(summary_size)));
+    auto sweep = [this, &sched, &vocab, &sketches, &summaries, &ahead,
+                  &stats](uint32_t thread_id) {
+        sketch_sink sink{sketches[thread_id], summaries[thread_id], min_n};
+        word_cache words(vocab);
+        for_each_text(thread_id, sched, ahead.get(), stats, [&](std::string_view text) {
+            process_text(text, sink, words, stats.thread(thread_id));
+        });
     };
-    // start all threads and wait for them to finish
     std::vector<std::thread> workers;
     for (uint32_t i = 0; i < num_threads; ++i)
-        workers.push_back(std::thread(sweep, i, std::move(files_to_sweep[i]),
-                                      std::move(promises[i]),
-                                      std::move(futures[i])));
+        workers.push_back(std::thread(sweep, i));
     for (auto& worker : workers) worker.join();
+    feeder.join();
+    if (readable)
+        *readable = found;
+    print_scheduler_stats(sched);
+
+    // sketches add up cell by cell, so there is nothing to shuffle; the rest
+    // is done here and counted on the first worker
+    lap_timer timer(stats, 0);
+    for (uint32_t i = 1; i < num_threads; i++) sketches[0].merge(sketches[i]);
+    timer.lap(phase::reduce);
+
+    // any thread's heavy hitters may be a global one; all of them are
+    // ranked by their estimate in the merged sketch
+    std::vector<std::vector<count_t>> tops;
+    for (uint32_t order = min_n; order <= n; order++) {
+        std::vector<std::pair<std::string_view, uint64_t>> candidates;
+        for (const auto& summary : summaries)
+            for (const auto& c : summary[order - min_n].counters())
+                candidates.emplace_back(c.key, c.hash);
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                         candidates.end());
+        top_k_heap best(top_k);
+        std::string text;
+        for (const auto& [key, hash] : candidates) {
+            uint64_t estimate = sketches[0].estimate(hash);
+            if (!best.may_take(estimate))
+                continue;
+            text.clear();
+            if (keys == key_mode::ids)
+                vocab.decode(key, text);
+            else
+                text = key;
+            best.push(text, estimate);
+        }
+        tops.push_back(best.take());
+    }
+    timer.lap(phase::select);
+    report_stats(stats, sched);
+    return tops;
+}
+
+bool wc::wordCounter::reduce_runs(const std::vector<fs::path>& runs,
+                                  const fs::path& store_dir, uint32_t partition,
+                                  const vocabulary& vocab, spill_area& spills,
+                                  std::vector<std::vector<count_t>>& tops) const {
+    // the runs are sorted by raw key, so equal keys meet in one streaming
+    // merge and only the top k stay in memory
+    std::vector<std::unique_ptr<store_reader>> readers;
+    std::vector<store_cursor> cursors;
+    for (const fs::path& run : runs) {
+        readers.push_back(std::make_unique<store_reader>(run, access_pattern::sequential));
+        cursors.emplace_back(*readers.back(), std::string_view());
+    }
+    sorted_merge merged(std::move(cursors));
+
+    // a store is ordered by text; id keys are decoded and sorted once more
+    std::unique_ptr<store_writer> writer;
+    std::unique_ptr<run_sorter> sorter;
+    if (!store_dir.empty()) {
+        writer = std::make_unique<store_writer>(store_file(store_dir, partition),
+                                                partition, num_threads);
+        if (keys == key_mode::ids)
+            sorter = std::make_unique<run_sorter>(spills, memory_budget / num_threads);
+    }
+
+    std::vector<top_k_heap> best(n - min_n + 1, top_k_heap(top_k));
+    std::string_view key;
+    uint64_t count;
+    std::string text;
+    while (merged.next(key, count)) {
+        top_k_heap& heap = best[order_of(key) - min_n];
+        bool wanted = heap.may_take(count);
+        if (keys == key_mode::ids && (wanted || sorter)) {
+            text.clear();
+            vocab.decode(key, text);
+        }
+        std::string_view shown = keys == key_mode::ids ? std::string_view(text) : key;
+        if (wanted)
+            heap.push(shown, count);
+        if (sorter)
+            sorter->add(shown, count);
+        else if (writer)
+            writer->add(key, count);
+    }
+    for (top_k_heap& heap : best) tops.push_back(heap.take());
+    if (sorter)
+        return sorter->finish(*writer);
+    return !writer || writer->finish();
 }
 
-void wc::wordCounter::process_file(fs::path& file, fmap& local_freq) {
-    // read the entire file and update local_freq
-    std::ifstream fin(file);
-    std::stringstream buffer;
-    buffer << fin.rdbuf();
-    std::string contents = buffer.str();
-    std::transform(contents.begin(), contents.end(), contents.begin(),
-                   [this](unsigned char c) {
-                       if (c == '\n' || c == '\t')
-                           return (int) ' ';
-                       if ((c >= '0' && c <= '9') || std::ispunct(c))
-                           return (int) default_punct;
-                       return std::tolower(c);
-                   });
-    // process the file
-    std::string my_string = std::string(contents);
-    while (my_string.size() > 0) {
-        std::stringstream my_sentence_stream;
-        size_t i = 0;
-        while (my_string[i] != default_punct && i < my_string.size()) {
-            my_sentence_stream << my_string[i];
-            i++;
-        }
-        const std::regex rgx("\\W+");
-        std::string my_sentence = my_sentence_stream.str();
-        std::sregex_token_iterator iter(my_sentence.begin(), my_sentence.end(),
-                                        rgx, -1);
-        std::sregex_token_iterator end;
-        // in case the first character of my_sentence is space, skip the parsed
-        // empty string
-        if (*iter == "")
-            iter++;
-        retrieve_n_gram(iter, end, local_freq);
-        my_string = i == my_string.size() ? my_string.substr(i)
-                                          : my_string.substr(i + 1);
-    }
-}
-
-void wc::wordCounter::retrieve_n_gram(std::sregex_token_iterator iter,
-                                      std::sregex_token_iterator end,
-                                      fmap& local_freq) {
-    if (std::distance(iter, end) < n)
+std::vector<std::vector<wc::wordCounter::count_t>> wc::wordCounter::count_incremental(
+    std::vector<fs::path>&& files, const fs::path& store_dir, uint32_t k, bool* updated) {
+    fs::create_directories(store_dir);
+    fs::path manifest_file = store_dir / "manifest";
+    manifest old = manifest::load(manifest_file);
+    // segments counted with other orders hold nothing this run can use
+    if (old.min_n != min_n || old.n != n || old.utf8 != (text == text_mode::utf8))
+        old.files.clear();
+
+    manifest next;
+    next.min_n = min_n;
+    next.n = n;
+    next.utf8 = text == text_mode::utf8;
+    next.next_segment = old.next_segment;
+
+    // a file is unchanged if its size and time match, or failing that its
+    // contents; a segment holding a changed or removed file is dropped and
+    // its unchanged files are counted again
+    std::set<uint32_t> dirty;
+    std::vector<std::pair<fs::path, manifest::file_entry>> changed;
+    std::map<std::string, manifest::file_entry> kept;
+    for (fs::path& file : files) {
+        manifest::file_entry entry;
+        std::error_code ec;
+        entry.size = fs::file_size(file, ec);
+        entry.mtime = fs::last_write_time(file, ec).time_since_epoch().count();
+        auto known = old.files.find(file.string());
+        if (known != old.files.end() && known->second.size == entry.size &&
+            known->second.mtime == entry.mtime) {
+            kept[file.string()] = known->second;
+            old.files.erase(known);
+            continue;
+        }
+        bool ok;
+        entry.hash = utils::file_hash(file, ok);
+        if (ok && known != old.files.end() && known->second.size == entry.size &&
+            known->second.hash == entry.hash) {
+            entry.segment = known->second.segment;
+            kept[file.string()] = entry;
+            old.files.erase(known);
+            continue;
+        }
+        // a file that could not be read is recorded so that it is never
+        // taken as unchanged, the next run looks at it again
+        if (!ok)
+            entry.mtime = entry.hash = 0;
+        if (known != old.files.end()) {
+            dirty.insert(known->second.segment);
+            old.files.erase(known);
+        }
+        changed.emplace_back(std::move(file), entry);
+    }
+    // whatever is left in the old manifest has been removed
+    for (const auto& [path, entry] : old.files) dirty.insert(entry.segment);
+    std::map<uint32_t, uint64_t> live;
+    for (auto& [path, entry] : kept) {
+        if (dirty.count(entry.segment) != 0)
+            changed.emplace_back(path, entry);
+        else
+            live[entry.segment] += entry.size;
+    }
+    for (const auto& [path, entry] : kept)
+        if (live.count(entry.segment) != 0)
+            next.files[path] = entry;
+
+    // the changed files go into new segments of at most segment_size bytes, so
+    // that a change later on only counts its own segment again
+    largest_files_first(changed);
+    for (size_t first = 0; first != changed.size();) {
+        uint32_t segment = next.next_segment++;
+        uint64_t bytes = 0;
+        std::vector<fs::path> batch;
+        size_t last = first;
+        for (; last != changed.size() &&
+               (batch.empty() || bytes + changed[last].second.size <= segment_size);
+             last++) {
+            bytes += changed[last].second.size;
+            changed[last].second.segment = segment;
+            next.files[changed[last].first.string()] = changed[last].second;
+            batch.push_back(changed[last].first);
+        }
+        first = last;
+        count(
+            [this, &batch](scheduler& sched) {
+                deal_work(std::move(batch), sched);
+                return true;
+            },
+            segment_dir(store_dir, segment));
+        live[segment] = bytes;
+    }
+
+    // segments below half the bound, from earlier runs or this one, are
+    // merged into as few as fit it, so their number stays small
+    std::vector<std::pair<uint32_t, uint64_t>> small;
+    for (const auto& [segment, bytes] : live)
+        if (bytes < segment_size / 2)
+            small.emplace_back(segment, bytes);
+    std::sort(small.begin(), small.end(),
+              [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::vector<std::vector<std::pair<uint32_t, uint64_t>>> groups;
+    std::vector<uint64_t> group_bytes;
+    for (const auto& s : small) {
+        size_t g = 0;
+        while (g != groups.size() && group_bytes[g] + s.second > segment_size) g++;
+        if (g == groups.size()) {
+            groups.emplace_back();
+            group_bytes.push_back(0);
+        }
+        groups[g].push_back(s);
+        group_bytes[g] += s.second;
+    }
+    std::vector<std::vector<count_t>> unused;
+    for (size_t g = 0; g != groups.size(); g++) {
+        if (groups[g].size() < 2)
+            continue;
+        std::vector<fs::path> inputs;
+        for (const auto& [segment, bytes] : groups[g])
+            inputs.push_back(segment_dir(store_dir, segment));
+        uint32_t merged = next.next_segment++;
+        fs::create_directories(segment_dir(store_dir, merged));
+        store_merge compaction(inputs, min_n, n, 0);
+        if (!compaction.is_open() ||
+            !compaction.write(segment_dir(store_dir, merged), num_threads, unused))
+            continue;
+        std::map<uint32_t, uint32_t> moved;
+        for (const auto& [segment, bytes] : groups[g]) {
+            moved[segment] = merged;
+            live.erase(segment);
+        }
+        live[merged] = group_bytes[g];
+        for (auto& [path, entry] : next.files)
+            if (moved.count(entry.segment) != 0)
+                entry.segment = merged;
+    }
+
+    // the store itself is the sum of the live segments
+    std::vector<fs::path> segments;
+    for (const auto& [segment, bytes] : live) segments.push_back(segment_dir(store_dir, segment));
+    store_merge merge(segments, min_n, n, k);
+    std::vector<std::vector<count_t>> tops;
+    if (!merge.is_open() || !merge.write(store_dir, num_threads, tops)) {
+        std::cerr << " * cannot update the store in " << store_dir.string()
+                  << std::endl;
+        if (updated)
+            *updated = false;
+        return std::vector<std::vector<count_t>>(n - min_n + 1);
+    }
+    if (!next.save(manifest_file)) {
+        std::cerr << " * cannot write " << manifest_file.string() << std::endl;
+        return tops;
+    }
+
+    // segments no longer in the manifest, including those of failed runs;
+    // a directory that is not named like a segment is left alone
+    remove_stale_partitions(store_dir, num_threads);
+    for (const auto& entry : fs::directory_iterator(store_dir)) {
+        std::string name = entry.path().filename().string();
+        uint32_t segment = 0;
+        if (!entry.is_directory() || name.rfind("seg-", 0) != 0 ||
+            std::from_chars(name.data() + 4, name.data() + name.size(), segment).ptr !=
+                name.data() + name.size())
+            continue;
+        if (live.count(segment) == 0)
+            fs::remove_all(entry.path());
+    }
+    return tops;
+}
+
+std::vector<std::vector<wc::wordCounter::count_t>> wc::wordCounter::count_cached(
+    bool* readable) {
+    // one entry per corpus, however its path is spelled, and per settings
+    // that change what is counted
+    fs::path corpus = fs::weakly_canonical(dir);
+    std::string settings = "n=" + std::to_string(min_n) + ".." + std::to_string(n) +
+                           (text == text_mode::utf8 ? " utf8" : "") + " ext=";
+    for (const std::string& extension : extensions) settings += extension + ",";
+    std::vector<fs::path> files = utils::find_all_files(corpus, input_filter(), scanners, readable);
+    // nothing is cached for a corpus that cannot be read
+    if (!*readable)
+        return std::vector<std::vector<count_t>>(n - min_n + 1);
+    uint64_t fingerprint = corpus_fingerprint(files, settings);
+    result_cache cache(cache_dir, corpus, settings);
+    std::vector<std::vector<count_t>> tops;
+    if (cache.lookup(fingerprint, min_n, n, top_k, tops))
+        return tops;
+
+    // the entry's store counts only what changed since it was last used,
+    // and keeps more than this run asks for
+    uint32_t kept = std::max(top_k, cached_top_k);
+    bool updated = true;
+    tops = count_incremental(std::move(files), cache.store_dir(), kept, &updated);
+    if (updated && !cache.save(fingerprint, min_n, n, kept, tops))
+        std::cerr << " * cannot write the cache in " << cache.store_dir().string() << std::endl;
+    for (std::vector<count_t>& top : tops)
+        if (top.size() > top_k)
+            top.resize(top_k);
+    return tops;
+}
+
+void wc::wordCounter::deal_work(std::vector<fs::path>&& files, scheduler& sched) const {
+    std::vector<work_item> all_items = plan_work(std::move(files));
+
+    // deal the work items out largest first, idle threads steal the rest
+    largest_first(all_items);
+    for (uint32_t i = 0; i < all_items.size(); i++)
+        sched.push(i % num_threads, std::move(all_items[i]));
+    sched.close();
+}
+
+bool wc::wordCounter::discover_work(scheduler& sched) const {
+    // every file becomes work the moment a scanner finds it; without the
+    // whole list there is no largest first, stealing evens the load instead
+    std::atomic<uint32_t> next_queue{0};
+    bool readable = utils::scan_files(dir, input_filter(), scanners, [&](fs::path&& file) {
+        std::vector<work_item> items;
+        plan_file(std::move(file), items);
+        for (work_item& item : items)
+            sched.push(next_queue++ % num_threads, std::move(item));
+    });
+    sched.close();
+    return readable;
+}
+
+void wc::wordCounter::print_scheduler_stats(const scheduler& sched) const {
+    if (!scheduler_stats)
         return;
-    std::stringstream my_n_gram_stream;
-    uint32_t i = 0;
-    while (i < n) {
-        my_n_gram_stream << *(std::next(iter, i));
-        if (i != n - 1)
-            my_n_gram_stream << " ";
-        i++;
-    }
-    std::string my_n_gram = my_n_gram_stream.str();
-    local_freq[my_n_gram]++;
-    retrieve_n_gram(++iter, end, local_freq);
-}
\ No newline at end of file
+    for (uint32_t i = 0; i != num_threads; i++) {
+        const wc::scheduler_stats& stats = sched.stats(i);
+        std::cerr << " * scheduler thread " << i << ": " << stats.executed
+                  << " items (" << stats.stolen << " stolen), "
+                  << stats.bytes << " bytes, idle "
+                  << stats.idle_seconds * 1000 << " ms" << std::endl;
+    }
+}
+
+std::function<bool(const std::string&)> wc::wordCounter::input_filter() const {
+    return [this](const std::string& name) {
+        for (const std::string& extension : extensions)
+            if (name.size() > extension.size() &&
+                name.compare(name.size() - extension.size(), extension.size(), extension) == 0)
+                return true;
+        return false;
+    };
+}
+
+std::vector<wc::work_item> wc::wordCounter::plan_work(
+    std::vector<fs::path>&& files) const {
+    std::vector<work_item> items;
+    for (fs::path& file : files) plan_file(std::move(file), items);
+    return items;
+}
+
+void wc::wordCounter::plan_file(fs::path&& file, std::vector<work_item>& items) const {
+    std::error_code ec;
+    uint64_t size = fs::file_size(file, ec);
+    if (ec)
+        size = 0;
+    if (compression_of(file) != compression::none) {
+        // a compressed file is decoded from its start, whole; text takes
+        // about four times the bytes of its gzip or zstd
+        items.push_back({std::move(file), 0, work_item::whole_file, 4 * size});
+        return;
+    }
+    if (chunk_size == 0 || size <= chunk_size) {
+        items.push_back({std::move(file), 0, work_item::whole_file, size});
+        return;
+    }
+    // large files are cut into chunks that become work items of their own
+    for (uint64_t offset = 0; offset < size; offset += chunk_size)
+        items.push_back({file, offset, chunk_size, std::min(chunk_size, size - offset)});
+}
+
+std::unique_ptr<wc::read_ahead> wc::wordCounter::start_reading(scheduler& sched) const {
+    if (io != io_mode::uring && io != io_mode::threads)
+        return nullptr;
+    auto ahead = std::make_unique<read_ahead>(sched, num_threads, io_depth, io_buffers,
+                                              io_buffer_size, io == io_mode::uring);
+    if (io == io_mode::uring && !ahead->uses_uring() && scheduler_stats)
+        std::cerr << " * io_uring is not available, reading with a thread pool\n";
+    return ahead;
+}
+
+template <class Fn>
+void wc::wordCounter::for_each_text(uint32_t thread_id, scheduler& sched,
+                                    read_ahead* ahead, run_stats& stats, Fn&& fn) const {
+    // waiting for work counts as reading it
+    lap_timer timer(stats, thread_id);
+    auto count = [&](std::string_view text) {
+        stats.thread(thread_id).bytes_read += text.size();
+        timer.lap(phase::read);
+        fn(text);
+        timer.lap(phase::map);
+    };
+    // a compressed item is counted a block at a time as it is decoded
+    auto count_item = [&](const work_item& item, io_mode mode) {
+        compression c = compression_of(item.path);
+        if (c == compression::none)
+            count(file_input(item, mode).text());
+        else if (!decompress(item.path, c, count))
+            std::cerr << " * cannot decompress " << item.path.string() << std::endl;
+    };
+    if (ahead == nullptr) {
+        work_item item;
+        while (sched.pop(thread_id, item)) count_item(item, io);
+        timer.lap(phase::read);
+        return;
+    }
+    read_ahead::filled buffer;
+    while (ahead->next(buffer)) {
+        if (buffer.read)
+            count(file_input(buffer.item, buffer.bytes, buffer.base, buffer.file_size).text());
+        else
+            count_item(buffer.item, io_mode::stream);
+        ahead->release(buffer);
+    }
+    timer.lap(phase::read);
+}
+
+void wc::wordCounter::feed(const work_source& source, scheduler& sched,
+                           run_stats& stats, bool& readable) const {
+    lap_timer timer(stats, num_threads);
+    readable = source(sched);
+    timer.lap(phase::discover);
+}
+
+void wc::wordCounter::report_stats(const run_stats& stats, const scheduler& sched) const {
+    if (stats_json)
+        stats.write_json(std::cerr, sched, num_threads);
+    if (!trace_file.empty() && !stats.write_trace(trace_file, num_threads))
+        std::cerr << " * cannot write " << trace_file.string() << std::endl;
+}
+
+template <class Sink>
+void wc::wordCounter::process_text(std::string_view text, Sink& sink,
+                                   word_cache& words, thread_stats& stats) {
+    // feed the n-grams of the text to the sink
+    if (this->text == text_mode::utf8) {
+        if (keys == key_mode::ids)
+            emit_ids<utf8_tokenizer>(text, min_n, n, sink, words, stats);
+        else
+            emit_text<utf8_tokenizer>(text, min_n, n, sink, stats);
+    } else if (keys == key_mode::ids) {
+        emit_ids(text, min_n, n, sink, words, stats);
+    } else {
+        emit_text(text, min_n, n, sink, stats);
+    }
+}
+
+uint32_t wc::wordCounter::order_of(std::string_view key) const {
+    // the orders share one key space, a key's length tells them apart
+    if (min_n == n)
+        return n;
+    if (keys == key_mode::ids)
+        return key.size() / sizeof(uint32_t);
+    return std::count(key.begin(), key.end(), ' ') + 1;
+}
+
+std::vector<wc::wordCounter::count_t> wc::wordCounter::top_entries(
+    const fmap& table, uint32_t order, const vocabulary& vocab) const {
+    // entries are ranked by count first, and only those that can make the
+    // top k are decoded to break ties on their text
+    return select_top(
+        table, top_k,
+        [this, order](const fmap::entry& e) { return order_of(e.key()) == order; },
+        [this, &vocab](const fmap::entry& e, std::string& text) {
+            if (keys == key_mode::ids)
+                vocab.decode(e.key(), text);
+            else
+                text = e.key();
+        });
+}
+
+void wc::wordCounter::rank_partition(fmap&& table, const vocabulary& vocab,
+                                     ranked_partition& ranked) const {
+    ranked.entries.reserve(table.size());
+    if (keys == key_mode::ids) {
+        // decode every key into one buffer first, it must not move once the
+        // views into it are taken
+        std::vector<size_t> ends;
+        ends.reserve(table.size());
+        for (const fmap::entry& e : table) {
+            vocab.decode(e.key(), ranked.decoded);
+            ends.push_back(ranked.decoded.size());
+        }
+        size_t begin = 0;
+        for (const fmap::entry& e : table) {
+            size_t end = ends[ranked.entries.size()];
+            ranked.entries.emplace_back(
+                std::string_view(ranked.decoded).substr(begin, end - begin), e.count);
+            begin = end;
+        }
+    } else {
+        // the keys stay in the table, which moves along with its arena
+        ranked.table = std::move(table);
+        for (const fmap::entry& e : ranked.table) ranked.entries.emplace_back(e.key(), e.count);
+    }
+    std::sort(ranked.entries.begin(), ranked.entries.end());
+}
+
+bool wc::wordCounter::write_partition(const fmap& table, const fs::path& store_dir,
+                                      uint32_t partition,
+                                      const vocabulary& vocab) const {
+    // the store is keyed by text, so id keys are decoded into one buffer
+    // before the views into it are taken
+    std::string decoded;
+    std::vector<size_t> ends;
+    if (keys == key_mode::ids) {
+        ends.reserve(table.size());
+        for (const fmap::entry& e : table) {
+            vocab.decode(e.key(), decoded);
+            ends.push_back(decoded.size());
+        }
+    }
+    std::vector<sorted_entry> sorted;
+    sorted.reserve(table.size());
+    size_t begin = 0;
+    for (const fmap::entry& e : table) {
+        std::string_view key = e.key();
+        if (keys == key_mode::ids) {
+            size_t end = ends[sorted.size()];
+            key = std::string_view(decoded).substr(begin, end - begin);
+            begin = end;
+        }
+        sorted.emplace_back(key, e.count);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    store_writer writer(store_file(store_dir, partition), partition, num_threads);
+    for (const sorted_entry& entry : sorted) writer.add(entry.key, entry.count);
+    return writer.finish();
+}
@@ -1,26 +1,217 @@
+#pragma once
+
+#include <algorithm>
 #include <filesystem>
+#include <functional>
 #include <map>
-#include <regex>
 #include <set>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "cluster.hpp"
+#include "counter_table.hpp"
+#include "decompress.hpp"
+#include "dump.hpp"
+#include "exchange.hpp"
+#include "file_input.hpp"
+#include "read_ahead.hpp"
+#include "run_stats.hpp"
+#include "scheduler.hpp"
+#include "spill.hpp"
+#include "top_k.hpp"
+#include "utf8.hpp"
+#include "vocabulary.hpp"
 
 namespace fs = std::filesystem;
 
 namespace wc {
-using fmap = std::unordered_map<std::string, uint64_t>;
+using fmap = counter_table;
+
+// how n-grams are keyed while counting
+enum class key_mode {
+    // packed 32-bit word ids from a shared vocabulary, decoded for output
+    ids,
+    // the words themselves, joined by a space
+    text
+};
+
+// a table on its way to a reducer, from the NUMA node of the thread that
+// filled it (`no_node` for another machine or an unpinned thread)
+struct shuffle_piece {
+    static constexpr uint32_t no_node = UINT32_MAX;
+
+    fmap table;
+    uint32_t node = no_node;
+};
+
+struct options {
+    // count every order from min_n to n in one pass, 0 counts n alone
+    uint32_t n = 1;
+    uint32_t min_n = 0;
+    uint32_t num_threads = 1;
+    // files are counted if their name ends in one of these; files ending in
+    // .gz or .zst are decoded as they are counted
+    std::vector<std::string> extensions = default_extensions();
+    io_mode io = io_mode::stream;
+    // with io_mode::uring or threads: reads kept in flight, buffers they fill
+    // (0 for io_depth plus two per thread) and the size of a buffer
+    uint32_t io_depth = 16;
+    uint32_t io_buffers = 0;
+    uint64_t io_buffer_size = 4 << 20;
+    // files larger than this are split into chunks, 0 keeps whole files
+    uint64_t chunk_size = 0;
+    key_mode keys = key_mode::ids;
+    // what a word is: runs of ascii letters, or of letters of UTF-8 text
+    text_mode text = text_mode::ascii;
+    // how many of the most frequent n-grams of each order are printed
+    uint32_t top_k = 5;
+    // write every count to a store in this directory, empty writes none
+    std::string output_dir;
+    // write every n-gram, ranked, to this file, empty writes none; not with
+    // a memory budget, an incremental or approximate count or a cluster
+    std::string dump_file;
+    dump_format dump_as = dump_format::tsv;
+    // only count files that changed since the store in output_dir was made
+    bool incremental = false;
+    // input bytes an incremental store counts into one segment at most; a
+    // changed file counts its segment again
+    uint64_t segment_size = 256 << 20;
+    // keep counts in a cache in this directory and answer from it while the
+    // corpus is unchanged, empty keeps none; not with output_dir
+    std::string cache_dir;
+    // bytes the count tables may take before they spill to disk, 0 for no
+    // limit, and where the runs go (the temporary directory by default)
+    uint64_t memory_budget = 0;
+    std::string spill_dir;
+    // pin each worker to a CPU, grouped by NUMA node, and keep every
+    // reducer's table in memory the reducer allocated
+    bool numa = false;
+    // threads listing directories, 0 for as many as num_threads
+    uint32_t scanners = 0;
+    // estimate the top k with fixed-size sketches instead of counting
+    // every n-gram, with this many counters per sketch row
+    bool approximate = false;
+    uint64_t sketch_width = 1 << 20;
+    // count on every node of a cluster, "host:port" of each, as this one
+    std::vector<std::string> cluster;
+    uint32_t rank = 0;
+    // print per-thread scheduler statistics to stderr
+    bool scheduler_stats = false;
+    // print a JSON summary of where each thread spent its time to stderr,
+    // and write every interval to trace_file in the Chrome trace format
+    bool stats_json = false;
+    std::string trace_file;
+};
+
+// the lowest order a count of opts makes, never above n
+inline uint32_t lowest_order(const options& opts) {
+    return opts.min_n == 0 ? opts.n : std::min(opts.min_n, opts.n);
+}
+
 class wordCounter {
     fs::path dir;
+    uint32_t min_n;
     uint32_t n;
     uint32_t num_threads;
-    const uint32_t header = 5;
-    char default_punct = '|';
+    std::vector<std::string> extensions;
+    io_mode io;
+    uint32_t io_depth;
+    uint32_t io_buffers;
+    uint64_t io_buffer_size;
+    uint64_t chunk_size;
+    key_mode keys;
+    text_mode text;
+    bool scheduler_stats;
+    bool stats_json;
+    fs::path trace_file;
+    uint32_t top_k;
+    fs::path output_dir;
+    fs::path dump_file;
+    dump_format dump_as;
+    bool incremental;
+    uint64_t segment_size;
+    fs::path cache_dir;
+    uint64_t memory_budget;
+    fs::path spill_dir;
+    uint32_t scanners;
+    bool numa;
+    bool approximate;
+    uint64_t sketch_width;
+    const uint32_t sketch_depth = 4;
+    std::vector<std::string> cluster_nodes;
+    uint32_t rank;
+
+    using count_t = ranked_entry;
+    // pushes the work of a count into the scheduler, then closes it; false
+    // if the corpus could not be read
+    using work_source = std::function<bool(scheduler&)>;
 
-    void process_file(fs::path& file, fmap& local_n_gram_freq);
-    void retrieve_n_gram(std::sregex_token_iterator iter, std::sregex_token_iterator end,
-                         fmap& local_n_gram_freq);
+    // whether a file of this name is part of the corpus
+    std::function<bool(const std::string&)> input_filter() const;
+    std::vector<work_item> plan_work(std::vector<fs::path>&& files) const;
+    void plan_file(fs::path&& file, std::vector<work_item>& items) const;
+    void deal_work(std::vector<fs::path>&& files, scheduler& sched) const;
+    bool discover_work(scheduler& sched) const;
+    void print_scheduler_stats(const scheduler& sched) const;
+    // the read-ahead stage of a count, null if mappers read their own items
+    std::unique_ptr<read_ahead> start_reading(scheduler& sched) const;
+    // hands the text of every item a mapper gets to fn, one item at a time
+    template <class Fn>
+    void for_each_text(uint32_t thread_id, scheduler& sched, read_ahead* ahead,
+                       run_stats& stats, Fn&& fn) const;
+    // runs the work source of a count on its own thread
+    void feed(const work_source& source, scheduler& sched, run_stats& stats,
+              bool& readable) const;
+    void report_stats(const run_stats& stats, const scheduler& sched) const;
+    // the sink takes every n-gram as add(key, hash, order)
+    template <class Sink>
+    void process_text(std::string_view text, Sink& sink, word_cache& words,
+                      thread_stats& stats);
+    uint32_t order_of(std::string_view key) const;
+    std::vector<count_t> top_entries(const fmap& table, uint32_t order,
+                                     const vocabulary& vocab) const;
+    // the entries of a reduced table, ranked, with their keys as text; filled
+    // in place, a short decoded buffer would not survive a move
+    void rank_partition(fmap&& table, const vocabulary& vocab,
+                        ranked_partition& ranked) const;
+    bool write_partition(const fmap& table, const fs::path& store_dir,
+                         uint32_t partition, const vocabulary& vocab) const;
+    /* the top k of each order; writes a store to store_dir unless it is
+    empty. With a cluster the partitions are spread over its nodes, and the
+    result is only complete on the first one. False in `readable` if the
+    source could not read the corpus. */
+    std::vector<std::vector<count_t>> count(const work_source& source,
+                                            const fs::path& store_dir,
+                                            cluster* nodes = nullptr,
+                                            bool* readable = nullptr);
+    std::vector<std::vector<count_t>> count_cluster(bool* readable);
+    // takes what another node sends until it is done, then hands the
+    // entries it sent for each reducer to the shuffle; under a memory budget
+    // they are spilled whenever they outgrow `share`
+    void receive_pieces(cluster& nodes, uint32_t node, scheduler& sched,
+                        exchange<shuffle_piece>& shuffle, spill_area* spills,
+                        uint64_t share) const;
+    /* brings the store in store_dir up to date with files and returns its
+    top k of each order; false in `updated` if it could not be */
+    std::vector<std::vector<count_t>> count_incremental(std::vector<fs::path>&& files,
+                                                        const fs::path& store_dir, uint32_t k,
+                                                        bool* updated = nullptr);
+    std::vector<std::vector<count_t>> count_cached(bool* readable);
+    std::vector<std::vector<count_t>> count_approx(const work_source& source,
+                                                   bool* readable);
+    bool reduce_runs(const std::vector<fs::path>& runs, const fs::path& store_dir,
+                     uint32_t partition, const vocabulary& vocab, spill_area& spills,
+                     std::vector<std::vector<count_t>>& tops) const;
 
    public:
     wordCounter(const std::string& dir, uint32_t n, uint32_t num_threads);
-    void process();
+    wordCounter(const std::string& dir, const options& opts);
+    /* counts the corpus and returns the top k of each order from min_n to n,
+    ranked; prints nothing but warnings to stderr. False in `readable`, and
+    nothing counted, if the directory cannot be read. */
+    std::vector<std::vector<ranked_entry>> run(bool* readable = nullptr);
+    // run() and print the result to stdout; false if nothing could be read
+    bool process();
 };
 }  // namespace wc
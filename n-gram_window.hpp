@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tokenizer.hpp"
+#include "vocabulary.hpp"
+
+namespace wc {
+/* sliding window over the last n words of the current sentence, emitting
+every order from min_n to n. Each push completes one n-gram per order; the
+longest one is built into a buffer owned by the window and every shorter
+order is a suffix of it, so all orders of a word cost O(n) together and
+nothing is allocated once the buffer has grown. */
+class ngram_window {
+    uint32_t min_n;
+    uint32_t n;
+    std::vector<std::string_view> ring;
+    uint32_t oldest = 0;
+    uint32_t filled = 0;
+    bool built = false;
+    std::string buffer;
+    // where the i-th word from the end of buffer starts
+    std::vector<uint32_t> starts;
+
+    void build() {
+        buffer.clear();
+        uint32_t i = oldest;
+        for (uint32_t k = filled; k != 0; k--) {
+            if (k != filled)
+                buffer.push_back(' ');
+            starts[k - 1] = buffer.size();
+            append_folded(buffer, ring[i]);
+            i = i + 1 == n ? 0 : i + 1;
+        }
+        built = true;
+    }
+
+   public:
+    ngram_window(uint32_t min_n, uint32_t n)
+        : min_n(min_n), n(n), ring(n), starts(n) {}
+    explicit ngram_window(uint32_t n) : ngram_window(n, n) {}
+
+    // forget the words of the current sentence
+    void reset() {
+        oldest = 0;
+        filled = 0;
+    }
+
+    // the longest order completed by `word`, 0 while below min_n words
+    uint32_t push(std::string_view word) {
+        if (n == 1) {
+            // unigrams are the folded word itself, nothing to join
+            buffer.clear();
+            append_folded(buffer, word);
+            return 1;
+        }
+        built = false;
+        if (filled != n) {
+            ring[filled++] = word;
+        } else {
+            ring[oldest] = word;
+            oldest = oldest + 1 == n ? 0 : oldest + 1;
+        }
+        return filled >= min_n ? filled : 0;
+    }
+
+    // the k-gram ending at the last word pushed, words joined by a space
+    std::string_view key(uint32_t k) {
+        if (n == 1)
+            return buffer;
+        if (!built)
+            build();
+        return std::string_view(buffer).substr(starts[k - 1]);
+    }
+};
+
+/* the same window over word ids, for keys in id form: the key of an n-gram is
+its ids packed back to back, so a k-gram is the last 4k bytes of the longest
+key and emitting all orders copies at most 4n bytes */
+class id_window {
+    uint32_t min_n;
+    uint32_t n;
+    std::vector<uint32_t> ring;
+    uint32_t oldest = 0;
+    uint32_t filled = 0;
+    bool built = false;
+    std::string buffer;
+
+    void build() {
+        buffer.clear();
+        uint32_t i = oldest;
+        for (uint32_t k = 0; k != filled; k++) {
+            append_id(buffer, ring[i]);
+            i = i + 1 == n ? 0 : i + 1;
+        }
+        built = true;
+    }
+
+   public:
+    id_window(uint32_t min_n, uint32_t n) : min_n(min_n), n(n), ring(n) {}
+    explicit id_window(uint32_t n) : id_window(n, n) {}
+
+    void reset() {
+        oldest = 0;
+        filled = 0;
+    }
+
+    uint32_t push(uint32_t id) {
+        if (n == 1) {
+            buffer.clear();
+            append_id(buffer, id);
+            return 1;
+        }
+        built = false;
+        if (filled != n) {
+            ring[filled++] = id;
+        } else {
+            ring[oldest] = id;
+            oldest = oldest + 1 == n ? 0 : oldest + 1;
+        }
+        return filled >= min_n ? filled : 0;
+    }
+
+    std::string_view key(uint32_t k) {
+        if (n == 1)
+            return buffer;
+        if (!built)
+            build();
+        return std::string_view(buffer).substr(buffer.size() - k * sizeof(uint32_t));
+    }
+};
+/* id_window for an n known at compile time. The window is an array shifted
+by one id per word, so the ids of every k-gram already lie back to back at
+its end: a key is a view into the window, never copied, and the shift and
+the hashing of each order unroll. */
+template <uint32_t N>
+class fixed_id_window {
+    std::array<uint32_t, N> ids{};
+    uint32_t filled = 0;
+
+   public:
+    void reset() { filled = 0; }
+
+    // the longest order completed by `id`
+    uint32_t push(uint32_t id) {
+        for (uint32_t i = 0; i + 1 < N; i++) ids[i] = ids[i + 1];
+        ids[N - 1] = id;
+        filled += filled != N;
+        return filled;
+    }
+
+    // the ids of the K-gram ending at the last id pushed
+    template <uint32_t K>
+    const uint32_t* last() const {
+        return ids.data() + N - K;
+    }
+    template <uint32_t K>
+    std::string_view key() const {
+        return {reinterpret_cast<const char*>(last<K>()), K * sizeof(uint32_t)};
+    }
+};
+}  // namespace wc
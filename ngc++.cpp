@@ -1,18 +1,222 @@
 #include <iostream>
+#include <string>
 
+#include "alloc_stats.hpp"
+#include "count_store.hpp"
 #include "n-gram_counter.hpp"
+#include "tokenizer.hpp"
+#include "utf8.hpp"
+#include "utils.hpp"
+
+static int usage(const char* prog) {
+    std::cout << "Usage: " << prog << " -n=<#gram>[..<#gram>] -t=<#threads> [options] <dir>\n"
+              << "       " << prog << " query [--text=utf8] <store dir> [<n-gram>...]\n"
+              << "Options:\n"
+              << "  --io=<mode>       stream, mmap, uring or threads (see README)\n"
+              << "  --io-depth=<n>    reads in flight with --io=uring|threads (16)\n"
+              << "  --io-buffers=<n>  read-ahead buffers (io depth + 2 per thread)\n"
+              << "  --io-buffer=<size> size of a read-ahead buffer (4M)\n"
+              << "  --chunk=<size>    split files larger than size into chunks\n"
+              << "  --ext=<ext>,...   count files whose name ends so (.txt,.txt.gz,.txt.zst)\n"
+              << "  --keys=ids|text   key n-grams by packed word ids or by text\n"
+              << "  --text=ascii|utf8 words of ascii letters, or of letters of any script\n"
+              << "  -k=<count>        print the count most frequent n-grams (5)\n"
+              << "  --out=<dir>       write every count to a store in dir\n"
+              << "  --incremental     only count files changed since the store was made\n"
+              << "  --segment=<size>  input bytes per segment of an incremental store (256M)\n"
+              << "  --cache=<dir>     answer from a cache of counts while the corpus is unchanged\n"
+              << "  --dump=<file>     write every n-gram, ranked, to file\n"
+              << "  --dump-format=tsv|bin  as tab-separated text (default) or binary\n"
+              << "  --mem=<size>      spill counts to disk beyond this much memory\n"
+              << "  --spill-dir=<dir> where spilled runs go (the temporary directory)\n"
+              << "  --scanners=<n>    threads listing directories (as many as -t)\n"
+              << "  --numa            pin threads by NUMA node, keep reduced tables local\n"
+              << "  --approx[=<w>]    estimate the top n-grams with sketches of width w\n"
+              << "  --cluster=<host:port>,... count on several nodes (see README)\n"
+              << "  --rank=<i>        the position of this node in --cluster (0)\n"
+              << "  --sched-stats     print scheduler statistics to stderr\n"
+              << "  --stats=json      print where each thread spent its time to stderr\n"
+              << "  --trace=<file>    write a Chrome trace of every thread to file"
+              << std::endl;
+    return 1;
+}
+
+// an n-gram as it is stored: its words folded and joined by a space
+template <class Tokenizer>
+static std::string normalize(const std::string& text) {
+    std::string key;
+    Tokenizer tok(text);
+    std::string_view word;
+    typename Tokenizer::token_type type;
+    while ((type = tok.next(word)) != Tokenizer::done) {
+        if (type != Tokenizer::word)
+            continue;
+        if (!key.empty())
+            key.push_back(' ');
+        wc::append_folded(key, word);
+    }
+    return key;
+}
+
+/* look n-grams up in a store written by --out, from the arguments or one per
+line of the standard input; --text=utf8 splits them as a store counted so */
+static int query(int argc, char* argv[]) {
+    int first = 2;
+    bool utf8 = argc > first && std::string(argv[first]) == "--text=utf8";
+    if (utf8)
+        first++;
+    if (argc <= first)
+        return usage(argv[0]);
+    wc::count_store store(argv[first], wc::access_pattern::random);
+    if (!store.is_open()) {
+        std::cerr << "cannot open a store in " << argv[first] << std::endl;
+        return 1;
+    }
+    auto lookup = [&store, utf8](const std::string& text) {
+        std::string key =
+            utf8 ? normalize<wc::utf8_tokenizer>(text) : normalize<wc::tokenizer>(text);
+        std::cout << key << ": " << store.find(key) << "\n";
+    };
+    if (argc > first + 1) {
+        for (int i = first + 1; i < argc; i++) lookup(argv[i]);
+    } else {
+        for (std::string line; std::getline(std::cin, line);) lookup(line);
+    }
+    std::cout << std::flush;
+    return 0;
+}
 
 /* this program computes n-gram frequencies for all .txt files in the given directory and its subdirectories
 Author: Tianjiao Li @ Cornell MAE
 Inspired by: Sagar Jha's wc++ program
 Highlight: this program is built around the map-reduce pattern in concurrent programming. */
 int main(int argc, char* argv[]) {
-    if (argc < 4 || std::string(argv[1]).substr(0, 3) != "-n=" || std::string(argv[2]).substr(0, 3) != "-t=") {
-        std::cout << "Usage: " << argv[0] << " -n=<#gram> -t=<#threads> <dir>" << std::endl;
-        return 1;
+    if (argc > 1 && std::string(argv[1]) == "query")
+        return query(argc, argv);
+    wc::options opts;
+    std::string dir;
+    bool has_n = false, has_t = false;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+            if (arg.substr(0, 3) == "-n=") {
+                // either a single order or a range such as 1..5
+                std::string orders = arg.substr(3);
+                size_t dots = orders.find("..");
+                opts.n = std::stoi(dots == std::string::npos ? orders
+                                                             : orders.substr(dots + 2));
+                opts.min_n = dots == std::string::npos ? 0 : std::stoi(orders.substr(0, dots));
+                has_n = true;
+            } else if (arg.substr(0, 3) == "-t=") {
+                opts.num_threads = std::stoi(arg.substr(3));
+                has_t = true;
+            } else if (arg == "--io=stream") {
+                opts.io = wc::io_mode::stream;
+            } else if (arg == "--io=mmap") {
+                opts.io = wc::io_mode::mmap;
+            } else if (arg == "--io=uring") {
+                opts.io = wc::io_mode::uring;
+            } else if (arg == "--io=threads") {
+                opts.io = wc::io_mode::threads;
+            } else if (arg.substr(0, 11) == "--io-depth=") {
+                opts.io_depth = std::stoi(arg.substr(11));
+            } else if (arg.substr(0, 13) == "--io-buffers=") {
+                opts.io_buffers = std::stoi(arg.substr(13));
+            } else if (arg.substr(0, 12) == "--io-buffer=") {
+                opts.io_buffer_size = utils::parse_size(arg.substr(12));
+            } else if (arg.substr(0, 8) == "--chunk=") {
+                opts.chunk_size = utils::parse_size(arg.substr(8));
+            } else if (arg.substr(0, 6) == "--ext=") {
+                std::string list = arg.substr(6);
+                opts.extensions.clear();
+                for (size_t start = 0; start <= list.size();) {
+                    size_t comma = std::min(list.find(',', start), list.size());
+                    opts.extensions.push_back(list.substr(start, comma - start));
+                    start = comma + 1;
+                }
+            } else if (arg == "--keys=ids") {
+                opts.keys = wc::key_mode::ids;
+            } else if (arg == "--keys=text") {
+                opts.keys = wc::key_mode::text;
+            } else if (arg == "--text=ascii") {
+                opts.text = wc::text_mode::ascii;
+            } else if (arg == "--text=utf8") {
+                opts.text = wc::text_mode::utf8;
+            } else if (arg.substr(0, 3) == "-k=") {
+                opts.top_k = std::stoul(arg.substr(3));
+            } else if (arg.substr(0, 6) == "--out=") {
+                opts.output_dir = arg.substr(6);
+            } else if (arg.substr(0, 7) == "--dump=") {
+                opts.dump_file = arg.substr(7);
+            } else if (arg == "--dump-format=tsv") {
+                opts.dump_as = wc::dump_format::tsv;
+            } else if (arg == "--dump-format=bin") {
+                opts.dump_as = wc::dump_format::binary;
+            } else if (arg.substr(0, 6) == "--mem=") {
+                opts.memory_budget = utils::parse_size(arg.substr(6));
+            } else if (arg.substr(0, 12) == "--spill-dir=") {
+                opts.spill_dir = arg.substr(12);
+            } else if (arg.substr(0, 11) == "--scanners=") {
+                opts.scanners = std::stoi(arg.substr(11));
+            } else if (arg == "--numa") {
+                opts.numa = true;
+            } else if (arg == "--approx") {
+                opts.approximate = true;
+            } else if (arg.substr(0, 9) == "--approx=") {
+                opts.approximate = true;
+                opts.sketch_width = utils::parse_size(arg.substr(9));
+            } else if (arg == "--incremental") {
+                opts.incremental = true;
+            } else if (arg.substr(0, 10) == "--segment=") {
+                opts.segment_size = utils::parse_size(arg.substr(10));
+            } else if (arg.substr(0, 8) == "--cache=") {
+                opts.cache_dir = arg.substr(8);
+            } else if (arg.substr(0, 10) == "--cluster=") {
+                std::string nodes = arg.substr(10);
+                for (size_t start = 0; start <= nodes.size();) {
+                    size_t comma = std::min(nodes.find(',', start), nodes.size());
+                    opts.cluster.push_back(nodes.substr(start, comma - start));
+                    start = comma + 1;
+                }
+            } else if (arg.substr(0, 7) == "--rank=") {
+                opts.rank = std::stoi(arg.substr(7));
+            } else if (arg == "--sched-stats") {
+                opts.scheduler_stats = true;
+            } else if (arg == "--stats=json") {
+                opts.stats_json = true;
+            } else if (arg.substr(0, 8) == "--trace=") {
+                opts.trace_file = arg.substr(8);
+            } else if (arg[0] != '-' && dir.empty()) {
+                dir = arg;
+            } else {
+                return usage(argv[0]);
+            }
+        }
+    } catch (const std::exception&) {
+        return usage(argv[0]);
+    }
+    if (!has_n || !has_t || dir.empty() || opts.n == 0 ||
+        opts.min_n > opts.n || opts.num_threads == 0 || opts.top_k == 0 ||
+        opts.io_depth == 0 || opts.io_buffer_size == 0 ||
+        (opts.incremental && opts.output_dir.empty()) ||
+        (opts.approximate && (!opts.output_dir.empty() || opts.memory_budget != 0 ||
+                              opts.sketch_width == 0)) ||
+        (!opts.cluster.empty() &&
+         (opts.rank >= opts.cluster.size() || !opts.output_dir.empty() ||
+          opts.approximate)) ||
+        (!opts.dump_file.empty() && (opts.memory_budget != 0 || opts.incremental ||
+                                     opts.approximate || !opts.cluster.empty())) ||
+        (!opts.cache_dir.empty() &&
+         (!opts.output_dir.empty() || opts.incremental || opts.approximate ||
+          !opts.cluster.empty() || !opts.dump_file.empty())))
+        return usage(argv[0]);
+    wc::wordCounter word_counter(dir, opts);
+    bool counted = word_counter.process();
+    if (utils::allocation_counting()) {
+        utils::alloc_counters counters = utils::allocation_counters();
+        std::cerr << " * allocations: " << counters.allocations << ", "
+                  << counters.bytes << " bytes, peak " << counters.peak_bytes
+                  << " bytes live" << std::endl;
     }
-    uint32_t n = std::stoi(std::string(argv[1]).substr(3));
-    uint32_t t = std::stoi(std::string(argv[2]).substr(3));
-    wc::wordCounter word_counter(argv[3], n, t);
-    word_counter.process();
+    return counted ? 0 : 1;
 }
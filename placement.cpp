@@ -0,0 +1,94 @@
+#include "placement.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+namespace {
+// a sysfs CPU list such as "0-3,8-11"
+std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size() && isdigit((unsigned char) text[pos])) {
+        size_t end;
+        int first = std::stoi(text.substr(pos), &end);
+        pos += end;
+        int last = first;
+        if (pos < text.size() && text[pos] == '-') {
+            last = std::stoi(text.substr(pos + 1), &end);
+            pos += end + 1;
+        }
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        if (pos < text.size() && text[pos] == ',')
+            pos++;
+    }
+    return cpus;
+}
+}  // namespace
+
+wc::thread_placement::thread_placement() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    auto usable = [&allowed](const std::vector<int>& cpus) {
+        std::vector<int> kept;
+        for (int cpu : cpus)
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                kept.push_back(cpu);
+        return kept;
+    };
+    std::error_code ec;
+    const fs::path nodes = "/sys/devices/system/node";
+    for (int node = 0;; node++) {
+        fs::path dir = nodes / ("node" + std::to_string(node));
+        if (!fs::exists(dir, ec))
+            break;
+        std::ifstream in(dir / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus = usable(parse_cpu_list(list));
+        if (!cpus.empty())
+            node_cpus.push_back(std::move(cpus));
+    }
+    if (node_cpus.empty()) {
+        std::vector<int> all;
+        for (int cpu = 0; cpu != CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                all.push_back(cpu);
+        node_cpus.push_back(std::move(all));
+    }
+    for (const std::vector<int>& cpus : node_cpus) num_cpus += cpus.size();
+}
+
+uint32_t wc::thread_placement::node_of(uint32_t thread_id, uint32_t num_threads) const {
+    // node i takes the threads whose share of the count falls in its share
+    // of the CPUs
+    uint64_t cpus_before = 0;
+    for (uint32_t node = 0; node + 1 < node_cpus.size(); node++) {
+        cpus_before += node_cpus[node].size();
+        if (uint64_t(thread_id) * num_cpus < cpus_before * num_threads)
+            return node;
+    }
+    return node_cpus.size() - 1;
+}
+
+bool wc::thread_placement::pin(uint32_t thread_id, uint32_t num_threads) const {
+    if (num_cpus == 0)
+        return false;
+    uint32_t node = node_of(thread_id, num_threads);
+    // the first thread of the node's block, the rest take its CPUs in turn
+    uint32_t first = thread_id;
+    while (first != 0 && node_of(first - 1, num_threads) == node) first--;
+    const std::vector<int>& cpus = node_cpus[node];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[(thread_id - first) % cpus.size()], &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace wc {
+/* where the worker threads of a count run when they are pinned. The CPUs
+the process may use are grouped by NUMA node, and the threads are split into
+one block per node in proportion to its CPUs, so thread i and its neighbours
+share a socket. Without NUMA information every CPU counts as node 0. */
+class thread_placement {
+    // the usable CPUs of each node, nodes without any are left out
+    std::vector<std::vector<int>> node_cpus;
+    uint32_t num_cpus = 0;
+
+   public:
+    thread_placement();
+
+    uint32_t num_nodes() const { return node_cpus.size(); }
+    // the position in node_cpus of the node for worker `thread_id`
+    uint32_t node_of(uint32_t thread_id, uint32_t num_threads) const;
+    // pin the calling thread to the CPU of worker `thread_id`, false if it
+    // cannot be pinned
+    bool pin(uint32_t thread_id, uint32_t num_threads) const;
+};
+}  // namespace wc
@@ -0,0 +1,142 @@
+#include "read_ahead.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "decompress.hpp"
+
+wc::read_ahead::read_ahead(scheduler& source, uint32_t num_queues, uint32_t depth,
+                           uint32_t num_buffers, size_t buffer_size, bool use_uring)
+    : source(source),
+      num_queues(num_queues),
+      depth(depth),
+      buffer_size(buffer_size),
+      reader(depth, use_uring),
+      memory(new char[num_buffers * buffer_size]),
+      slots(num_buffers) {
+    for (uint32_t i = num_buffers; i != 0; i--) free_buffers.push_back(i - 1);
+    submitter = std::thread(&read_ahead::submit_all, this);
+    reaper = std::thread(&read_ahead::reap_all, this);
+}
+
+wc::read_ahead::~read_ahead() {
+    submitter.join();
+    reaper.join();
+}
+
+bool wc::read_ahead::next(filled& out) {
+    std::unique_lock<std::mutex> lock(mtx);
+    ready_cv.wait(lock, [this] { return !ready.empty() || !reaping; });
+    if (ready.empty())
+        return false;
+    out = std::move(ready.front());
+    ready.pop_front();
+    return true;
+}
+
+void wc::read_ahead::release(const filled& done) {
+    if (done.buffer == no_buffer)
+        return;
+    std::lock_guard<std::mutex> lock(mtx);
+    free_buffers.push_back(done.buffer);
+    space.notify_one();
+}
+
+void wc::read_ahead::hand_over(filled&& f) {
+    std::lock_guard<std::mutex> lock(mtx);
+    ready.push_back(std::move(f));
+    ready_cv.notify_one();
+}
+
+void wc::read_ahead::submit_all() {
+    work_item item;
+    for (uint32_t turn = 0; source.pop(turn % num_queues, item); turn++) {
+        // the mapper decodes a compressed file as it reads it
+        if (compression_of(item.path) != compression::none) {
+            filled f;
+            f.item = std::move(item);
+            hand_over(std::move(f));
+            continue;
+        }
+        int fd = open(item.path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        uint64_t size = fd < 0 ? 0 : st.st_size;
+        // the byte before the range tells whether a sentence starts on it
+        uint64_t base = item.offset == 0 ? 0 : item.offset - 1;
+        uint64_t end = item.length >= size - std::min(item.offset, size)
+                           ? size
+                           : item.offset + item.length;
+        if (fd < 0 || base >= end || end - base > buffer_size) {
+            if (fd >= 0)
+                close(fd);
+            filled f;
+            f.item = std::move(item);
+            hand_over(std::move(f));
+            continue;
+        }
+        uint32_t index;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            space.wait(lock, [this] { return !free_buffers.empty() && in_flight < depth; });
+            index = free_buffers.back();
+            free_buffers.pop_back();
+            in_flight++;
+        }
+        // read as much past the range as fits, for the tail of its last sentence
+        uint64_t wanted = std::min<uint64_t>(buffer_size, size - base);
+        slots[index] = {std::move(item), fd, base, size, wanted, 0};
+        reader.submit({fd, buffer(index), wanted, base, index});
+        submitted.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    submitting = false;
+    submitted.notify_one();
+}
+
+void wc::read_ahead::reap_all() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            submitted.wait(lock, [this] { return in_flight != 0 || !submitting; });
+            if (in_flight == 0)
+                break;
+        }
+        uint64_t tag;
+        int64_t result;
+        reader.wait(tag, result);
+        uint32_t index = tag;
+        slot& s = slots[index];
+        if (result > 0) {
+            s.got += result;
+            // a short read is continued where it stopped
+            if (s.got < s.wanted) {
+                reader.submit({s.fd, buffer(index) + s.got, s.wanted - s.got,
+                               s.base + s.got, index});
+                continue;
+            }
+        }
+        close(s.fd);
+        filled f;
+        f.item = std::move(s.item);
+        f.buffer = index;
+        f.bytes = std::string_view(buffer(index), s.got);
+        f.base = s.base;
+        f.file_size = s.file_size;
+        f.read = result >= 0;
+        std::lock_guard<std::mutex> lock(mtx);
+        in_flight--;
+        ready.push_back(std::move(f));
+        ready_cv.notify_one();
+        space.notify_one();
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    reaping = false;
+    ready_cv.notify_all();
+}
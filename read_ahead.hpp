@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "async_reader.hpp"
+#include "file_input.hpp"
+#include "scheduler.hpp"
+
+namespace wc {
+/* the I/O stage of a count: takes work items from the scheduler, keeps up to
+`depth` reads in flight into a fixed pool of reusable buffers, and hands the
+filled buffers to the mappers, which give them back once they are done. One
+thread submits and one reaps, so mappers never block on a read. An item that
+does not fit a buffer, with the tail of its last sentence, or a compressed
+one is handed over unread and the mapper reads it itself. */
+class read_ahead {
+   public:
+    static constexpr uint32_t no_buffer = UINT32_MAX;
+
+    struct filled {
+        work_item item;
+        uint32_t buffer = no_buffer;
+        // the file contents from `base` on, as far as they were read
+        std::string_view bytes;
+        uint64_t base = 0;
+        uint64_t file_size = 0;
+        // false if the stage did not read the item
+        bool read = false;
+    };
+
+    read_ahead(scheduler& source, uint32_t num_queues, uint32_t depth,
+               uint32_t num_buffers, size_t buffer_size, bool use_uring);
+    ~read_ahead();
+    read_ahead(const read_ahead&) = delete;
+    read_ahead& operator=(const read_ahead&) = delete;
+
+    bool uses_uring() const { return reader.uses_uring(); }
+    // the next filled buffer; false once every item has been handed out
+    bool next(filled& out);
+    void release(const filled& done);
+
+   private:
+    struct slot {
+        work_item item;
+        int fd;
+        uint64_t base;
+        uint64_t file_size;
+        uint64_t wanted;
+        uint64_t got;
+    };
+
+    scheduler& source;
+    uint32_t num_queues;
+    uint32_t depth;
+    size_t buffer_size;
+    async_reader reader;
+    std::unique_ptr<char[]> memory;
+    std::vector<slot> slots;
+
+    std::mutex mtx;
+    // a buffer was freed or a read finished, more submissions may be possible
+    std::condition_variable space;
+    // a read was submitted or the submitter is done
+    std::condition_variable submitted;
+    // a buffer was filled or the stage is done
+    std::condition_variable ready_cv;
+    std::vector<uint32_t> free_buffers;
+    std::deque<filled> ready;
+    uint32_t in_flight = 0;
+    bool submitting = true;
+    bool reaping = true;
+    std::thread submitter;
+    std::thread reaper;
+
+    char* buffer(uint32_t index) const { return memory.get() + index * buffer_size; }
+    void hand_over(filled&& f);
+    void submit_all();
+    void reap_all();
+};
+}  // namespace wc
@@ -0,0 +1,146 @@
+#include "result_cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+uint64_t mix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * 0xff51afd7ed558ccdull;
+    return hash ^ (hash >> 29);
+}
+
+uint64_t mix(uint64_t hash, const std::string& text) {
+    for (unsigned char c : text) hash = mix(hash, c);
+    return mix(hash, text.size());
+}
+
+// read `size` bytes at `p` into `out`, false if they run past `end`
+bool take(const char*& p, const char* end, void* out, size_t size) {
+    if ((size_t) (end - p) < size)
+        return false;
+    std::memcpy(out, p, size);
+    p += size;
+    return true;
+}
+
+bool write_file(const fs::path& file, const std::string& bytes) {
+    fs::path temporary = file;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        if (out.fail())
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(temporary, file, ec);
+    return !ec;
+}
+}  // namespace
+
+uint64_t wc::corpus_fingerprint(const std::vector<fs::path>& files,
+                                const std::string& settings) {
+    // the scanners find files in any order
+    std::vector<std::string> paths;
+    for (const fs::path& file : files) paths.push_back(file.string());
+    std::sort(paths.begin(), paths.end());
+    uint64_t hash = mix(0x9e3779b97f4a7c15ull, settings);
+    for (const std::string& path : paths) {
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        int64_t mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+        hash = mix(mix(mix(hash, path), size), mtime);
+    }
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 32);
+}
+
+wc::result_cache::result_cache(const fs::path& cache_dir, const fs::path& dir,
+                               const std::string& settings)
+    : key(dir.string() + "\n" + settings + "\n") {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << mix(0, key);
+    entry = cache_dir / name.str();
+}
+
+bool wc::result_cache::lookup(uint64_t fingerprint, uint32_t min_n, uint32_t n,
+                              uint32_t top_k,
+                              std::vector<std::vector<ranked_entry>>& tops) const {
+    // another corpus or settings sharing the name of the entry
+    std::ifstream key_file(entry / "key", std::ios::binary);
+    std::string stored((std::istreambuf_iterator<char>(key_file)),
+                       std::istreambuf_iterator<char>());
+    if (stored != key)
+        return false;
+
+    int fd = open((entry / "result").c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void* addr = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(result_header)
+                     ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+    const char* p = static_cast<const char*>(addr);
+    const char* end = p + st.st_size;
+    result_header header;
+    take(p, end, &header, sizeof(header));
+    bool ok = std::memcmp(header.magic, result_header::magic_bytes, sizeof(header.magic)) == 0 &&
+              header.fingerprint == fingerprint && header.min_n == min_n && header.n == n &&
+              header.top_k >= top_k;
+
+    std::vector<std::vector<ranked_entry>> result(n - min_n + 1);
+    for (std::vector<ranked_entry>& top : result) {
+        uint32_t num_entries = 0;
+        ok = ok && take(p, end, &num_entries, sizeof(num_entries));
+        for (uint32_t i = 0; ok && i != num_entries; i++) {
+            uint64_t count;
+            uint32_t length;
+            ok = take(p, end, &count, sizeof(count)) && take(p, end, &length, sizeof(length)) &&
+                 length <= (size_t) (end - p);
+            if (ok && i < top_k)
+                top.emplace_back(std::string(p, length), count);
+            p += ok ? length : 0;
+        }
+    }
+    munmap(addr, st.st_size);
+    if (ok)
+        tops = std::move(result);
+    return ok;
+}
+
+bool wc::result_cache::save(uint64_t fingerprint, uint32_t min_n, uint32_t n, uint32_t top_k,
+                            const std::vector<std::vector<ranked_entry>>& tops) const {
+    result_header header;
+    std::memcpy(header.magic, result_header::magic_bytes, sizeof(header.magic));
+    header.min_n = min_n;
+    header.n = n;
+    header.top_k = top_k;
+    header.fingerprint = fingerprint;
+    std::string bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const std::vector<ranked_entry>& top : tops) {
+        uint32_t num_entries = top.size();
+        bytes.append(reinterpret_cast<const char*>(&num_entries), sizeof(num_entries));
+        for (const ranked_entry& e : top) {
+            uint32_t length = e.first.size();
+            bytes.append(reinterpret_cast<const char*>(&e.second), sizeof(e.second));
+            bytes.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            bytes.append(e.first);
+        }
+    }
+    // the key goes first, a result is only read under the key it was made for
+    std::error_code ec;
+    fs::create_directories(entry, ec);
+    return write_file(entry / "key", key) && write_file(entry / "result", bytes);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "top_k.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* the result a cache entry was last counted to, in native byte order:
+
+    header   magic "ngr1", lowest and highest order, entries kept per order
+             (u32 each), fingerprint of the corpus (u64)
+    orders   per order: number of entries (u32), then per entry the count
+             (u64), key length (u32), key bytes */
+struct result_header {
+    static constexpr char magic_bytes[4] = {'n', 'g', 'r', '1'};
+
+    char magic[4];
+    uint32_t min_n;
+    uint32_t n;
+    uint32_t top_k;
+    uint64_t fingerprint;
+};
+
+/* a 64-bit hash of a listing of the corpus, the path, size and modification
+time of every file in any order, together with the settings of the count;
+not cryptographic */
+uint64_t corpus_fingerprint(const std::vector<fs::path>& files, const std::string& settings);
+
+/* finished counts kept in a directory, an entry per corpus directory and
+settings. An entry is an incremental store of the corpus, so a stale one is
+brought up to date by counting what changed, along with the ranked top
+entries counted from the listing of a fingerprint. */
+class result_cache {
+    fs::path entry;
+    std::string key;
+
+   public:
+    result_cache(const fs::path& cache_dir, const fs::path& dir, const std::string& settings);
+    // the store of the entry, to count into and to query
+    const fs::path& store_dir() const { return entry; }
+    /* the top `top_k` of each order from min_n to n, read from the mapped
+    result, if the entry was counted from this fingerprint and kept as many */
+    bool lookup(uint64_t fingerprint, uint32_t min_n, uint32_t n, uint32_t top_k,
+                std::vector<std::vector<ranked_entry>>& tops) const;
+    // record the result of a count that kept `top_k` entries per order
+    bool save(uint64_t fingerprint, uint32_t min_n, uint32_t n, uint32_t top_k,
+              const std::vector<std::vector<ranked_entry>>& tops) const;
+};
+}  // namespace wc
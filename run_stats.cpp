@@ -0,0 +1,67 @@
+#include "run_stats.hpp"
+
+#include <fstream>
+
+const char* wc::phase_name(phase p) {
+    static const char* names[] = {"discover", "read",   "map",    "shuffle",
+                                  "reduce_wait", "reduce", "select", "write"};
+    return names[size_t(p)];
+}
+
+void wc::run_stats::write_json(std::ostream& out, const scheduler& sched,
+                               uint32_t num_workers) const {
+    thread_stats total;
+    for (const thread_stats& t : threads) {
+        for (size_t p = 0; p != size_t(phase::num_phases); p++) total.seconds[p] += t.seconds[p];
+        total.bytes_read += t.bytes_read;
+        total.words += t.words;
+        total.ngrams += t.ngrams;
+        total.distinct_keys += t.distinct_keys;
+        total.table_rehashes += t.table_rehashes;
+    }
+    auto write_thread = [&out](const thread_stats& t) {
+        out << "\"seconds\": {";
+        for (size_t p = 0; p != size_t(phase::num_phases); p++)
+            out << (p == 0 ? "" : ", ") << '"' << phase_name(phase(p)) << "\": " << t.seconds[p];
+        out << "}, \"bytes_read\": " << t.bytes_read << ", \"words\": " << t.words
+            << ", \"ngrams\": " << t.ngrams << ", \"distinct_keys\": " << t.distinct_keys
+            << ", \"table_rehashes\": " << t.table_rehashes;
+    };
+    out << "{\"wall_seconds\": " << now() << ",\n \"total\": {";
+    write_thread(total);
+    out << "},\n \"threads\": [";
+    for (uint32_t i = 0; i != threads.size(); i++) {
+        out << (i == 0 ? "\n  {" : ",\n  {");
+        if (i < num_workers) {
+            const scheduler_stats& s = sched.stats(i);
+            out << "\"thread\": " << i << ", \"role\": \"worker\", \"items\": " << s.executed
+                << ", \"stolen\": " << s.stolen << ", \"work_wait_seconds\": " << s.idle_seconds
+                << ", ";
+        } else {
+            out << "\"thread\": " << i << ", \"role\": \"discovery\", ";
+        }
+        write_thread(threads[i]);
+        out << "}";
+    }
+    out << "\n ]}" << std::endl;
+}
+
+bool wc::run_stats::write_trace(const fs::path& file, uint32_t num_workers) const {
+    std::ofstream out(file);
+    // microseconds, one process with a named track per thread
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* separator = "\n";
+    for (uint32_t i = 0; i != threads.size(); i++) {
+        out << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i
+            << ", \"args\": {\"name\": \""
+            << (i < num_workers ? "worker " + std::to_string(i) : std::string("discovery"))
+            << "\"}}";
+        separator = ",\n";
+        for (const thread_stats::span& s : threads[i].spans)
+            out << ",\n{\"name\": \"" << phase_name(s.what) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                << i << ", \"ts\": " << uint64_t(s.start * 1e6)
+                << ", \"dur\": " << uint64_t(s.duration * 1e6) << "}";
+    }
+    out << "\n]}" << std::endl;
+    return bool(out);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <vector>
+
+#include "scheduler.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+// what a thread of a count can spend its time on
+enum class phase : uint32_t {
+    // listing the corpus and planning work items
+    discover,
+    // getting the bytes of a work item
+    read,
+    // tokenizing it and counting its n-grams into tables
+    map,
+    // sending the tables to their reducers
+    shuffle,
+    // a reducer waiting for the next table
+    reduce_wait,
+    // a reducer merging tables
+    reduce,
+    // selecting the top k
+    select,
+    // writing a store partition
+    write,
+    num_phases
+};
+
+const char* phase_name(phase p);
+
+/* what one thread of a count did. Only that thread writes it while the count
+runs, nothing is shared or atomic. */
+struct thread_stats {
+    double seconds[size_t(phase::num_phases)] = {};
+    uint64_t bytes_read = 0;
+    uint64_t words = 0;
+    uint64_t ngrams = 0;
+    // keys of the partition the thread reduced
+    uint64_t distinct_keys = 0;
+    uint64_t table_rehashes = 0;
+
+    // one per timed interval when tracing, in seconds since the count began
+    struct span {
+        phase what;
+        double start;
+        double duration;
+    };
+    std::vector<span> spans;
+};
+
+/* the instrumentation of one count: a thread_stats for each of its threads
+and the monotonic clock they share. Timing costs two clock reads per work
+item and phase, so it is always on; intervals are only kept for a trace. */
+class run_stats {
+    using clock = std::chrono::steady_clock;
+    clock::time_point started = clock::now();
+    bool tracing;
+    std::vector<thread_stats> threads;
+
+   public:
+    run_stats(uint32_t num_threads, bool tracing)
+        : tracing(tracing), threads(num_threads) {}
+
+    thread_stats& thread(uint32_t id) { return threads[id]; }
+    // seconds since the count began
+    double now() const {
+        return std::chrono::duration<double>(clock::now() - started).count();
+    }
+    // thread `id` spent the time from `since` to now on `what`; returns now
+    double record(uint32_t id, phase what, double since) {
+        double t = now();
+        threads[id].seconds[size_t(what)] += t - since;
+        if (tracing)
+            threads[id].spans.push_back({what, since, t - since});
+        return t;
+    }
+
+    /* the summary as one JSON object. The first threads are those of the
+    scheduler, the last one lists the corpus. */
+    void write_json(std::ostream& out, const scheduler& sched, uint32_t num_workers) const;
+    // every interval in the Chrome trace event format, false if it fails
+    bool write_trace(const fs::path& file, uint32_t num_workers) const;
+};
+
+// times consecutive phases of one thread, each lap ends the one before
+class lap_timer {
+    run_stats& stats;
+    uint32_t id;
+    double since;
+
+   public:
+    lap_timer(run_stats& stats, uint32_t id) : stats(stats), id(id), since(stats.now()) {}
+    void lap(phase what) { since = stats.record(id, what, since); }
+};
+}  // namespace wc
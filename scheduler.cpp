@@ -0,0 +1,85 @@
+#include "scheduler.hpp"
+
+#include <chrono>
+
+wc::scheduler::scheduler(uint32_t num_threads)
+    : queues(num_threads), thread_stats(num_threads) {}
+
+void wc::scheduler::push(uint32_t thread_id, work_item&& item) {
+    {
+        // counted under the same lock take() uncounts it under, so pending
+        // never drops below zero for an item stolen right away
+        std::lock_guard<std::mutex> lock(queues[thread_id].mtx);
+        queues[thread_id].items.push_back(std::move(item));
+        pending++;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    cv.notify_one();
+}
+
+void wc::scheduler::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    cv.notify_all();
+}
+
+void wc::scheduler::wait_below(uint64_t count) {
+    std::unique_lock<std::mutex> lock(mtx);
+    low_mark = count;
+    drained.wait(lock, [this, count] { return pending.load() < count; });
+    low_mark = 0;
+}
+
+bool wc::scheduler::take(uint32_t victim, work_item& item) {
+    {
+        std::lock_guard<std::mutex> lock(queues[victim].mtx);
+        if (queues[victim].items.empty())
+            return false;
+        item = std::move(queues[victim].items.front());
+        queues[victim].items.pop_front();
+        pending--;
+    }
+    if (pending.load() < low_mark.load()) {
+        std::lock_guard<std::mutex> lock(mtx);
+        drained.notify_all();
+    }
+    return true;
+}
+
+bool wc::scheduler::pop(uint32_t thread_id, work_item& item) {
+    scheduler_stats& my_stats = thread_stats[thread_id];
+    if (take(thread_id, item)) {
+        my_stats.executed++;
+        my_stats.bytes += item.cost;
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool found = false;
+    for (;;) {
+        uint32_t num_threads = queues.size();
+        for (uint32_t i = 1; i != num_threads && !found; i++) {
+            if (take((thread_id + i) % num_threads, item)) {
+                my_stats.stolen++;
+                found = true;
+            }
+        }
+        if (!found)
+            found = take(thread_id, item);
+        if (found)
+            break;
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return pending.load() != 0 || closed; });
+        // a thief may have taken what woke us, so only a closed and drained
+        // scheduler ends the loop; anything else means steal again
+        if (closed && pending.load() == 0)
+            break;
+    }
+    my_stats.idle_seconds += std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+    if (!found)
+        return false;
+    my_stats.executed++;
+    my_stats.bytes += item.cost;
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "file_input.hpp"
+
+namespace wc {
+struct scheduler_stats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+    uint64_t bytes = 0;
+    // time spent looking for work outside the thread's own deque
+    double idle_seconds = 0;
+};
+
+/* hands out work items through one deque per thread. A thread drains its own
+deque from the front and, once it is empty, steals the front of the other
+deques, so a thread stuck on a huge file does not hold up everyone else.
+Items may be pushed while workers are already running; pop() blocks until
+work arrives or the scheduler has been closed and drained. */
+class scheduler {
+    struct alignas(64) queue {
+        std::mutex mtx;
+        std::deque<work_item> items;
+    };
+    std::vector<queue> queues;
+    std::vector<scheduler_stats> thread_stats;
+    std::atomic<uint64_t> pending = 0;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    // wait_below() sleeps on `drained` until pending falls under the mark
+    std::atomic<uint64_t> low_mark = 0;
+    std::condition_variable drained;
+
+    bool take(uint32_t victim, work_item& item);
+
+   public:
+    explicit scheduler(uint32_t num_threads);
+
+    void push(uint32_t thread_id, work_item&& item);
+    // no more pushes will follow
+    void close();
+    // block until fewer than `count` items wait to be handed out, so whoever
+    // pushes can fetch work only as fast as it is done
+    void wait_below(uint64_t count);
+    // next item for `thread_id`; false once every item has been handed out
+    bool pop(uint32_t thread_id, work_item& item);
+
+    const scheduler_stats& stats(uint32_t thread_id) const {
+        return thread_stats[thread_id];
+    }
+};
+}  // namespace wc
@@ -0,0 +1,105 @@
+#include "sketch.hpp"
+
+#include <algorithm>
+#include <utility>
+
+wc::count_min_sketch::count_min_sketch(size_t width, uint32_t depth)
+    : width(1), depth(depth) {
+    while (this->width < width) this->width *= 2;
+    cells.assign(this->width * depth, 0);
+}
+
+uint64_t wc::count_min_sketch::estimate(uint64_t hash) const {
+    uint64_t smallest = UINT64_MAX;
+    for (uint32_t row = 0; row != depth; row++)
+        smallest = std::min(smallest, cells[cell(hash, row)]);
+    return smallest;
+}
+
+void wc::count_min_sketch::merge(const count_min_sketch& other) {
+    for (size_t i = 0; i != cells.size(); i++) cells[i] += other.cells[i];
+}
+
+wc::heavy_hitters::heavy_hitters(size_t capacity) : capacity(capacity) {
+    size_t slots = 16;
+    // at most half full, so probe runs stay short
+    while (slots < capacity * 2) slots *= 2;
+    index.assign(slots, none);
+    heap.reserve(capacity);
+}
+
+void wc::heavy_hitters::place(size_t position) {
+    index[heap[position].slot] = position;
+}
+
+void wc::heavy_hitters::sift_up(size_t position) {
+    while (position != 0 && heap[position].count < heap[(position - 1) / 2].count) {
+        size_t parent = (position - 1) / 2;
+        std::swap(heap[position], heap[parent]);
+        place(position);
+        position = parent;
+    }
+    place(position);
+}
+
+void wc::heavy_hitters::sift_down(size_t position) {
+    for (;;) {
+        size_t smallest = position;
+        for (size_t child = position * 2 + 1; child <= position * 2 + 2; child++)
+            if (child < heap.size() && heap[child].count < heap[smallest].count)
+                smallest = child;
+        if (smallest == position)
+            return;
+        std::swap(heap[position], heap[smallest]);
+        place(position);
+        place(smallest);
+        position = smallest;
+    }
+}
+
+void wc::heavy_hitters::unlink(size_t slot) {
+    // backward shift deletion keeps every key reachable from its home
+    size_t mask = index.size() - 1;
+    index[slot] = none;
+    for (size_t next = (slot + 1) & mask; index[next] != none; next = (next + 1) & mask) {
+        size_t wanted = home(heap[index[next]].hash);
+        // move the entry back if its home is not in (slot, next]
+        if (((next - wanted) & mask) >= ((next - slot) & mask)) {
+            index[slot] = index[next];
+            heap[index[slot]].slot = slot;
+            index[next] = none;
+            slot = next;
+        }
+    }
+}
+
+void wc::heavy_hitters::update(std::string_view key, uint64_t hash,
+                               uint64_t estimate) {
+    size_t mask = index.size() - 1;
+    size_t slot = home(hash);
+    for (; index[slot] != none; slot = (slot + 1) & mask) {
+        counter& c = heap[index[slot]];
+        if (c.hash == hash && c.key == key) {
+            c.count = estimate;
+            sift_down(index[slot]);
+            return;
+        }
+    }
+    if (heap.size() < capacity) {
+        heap.push_back({std::string(key), hash, estimate, slot});
+        sift_up(heap.size() - 1);
+        return;
+    }
+    // replace the smallest counter, which is the root
+    counter& root = heap[0];
+    unlink(root.slot);
+    // the unlink may have moved an entry into the free slot found above
+    slot = home(hash);
+    while (index[slot] != none) slot = (slot + 1) & mask;
+    root.key.assign(key);
+    root.hash = hash;
+    root.count = estimate;
+    root.slot = slot;
+    place(0);
+    sift_down(0);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wc {
+/* Count-Min Sketch over 64-bit key hashes: `depth` rows of `width` counters,
+each key adding to one counter per row. The estimate of a key is the
+smallest of its counters, which never undercounts and overcounts by at most
+e/width of the total with probability 1 - e^-depth. Sketches of the same
+shape merge by adding their cells, whatever they have seen. */
+class count_min_sketch {
+    size_t width;
+    uint32_t depth;
+    std::vector<uint64_t> cells;
+
+    // the counter of `hash` in `row`, by double hashing on its two halves
+    size_t cell(uint64_t hash, uint32_t row) const {
+        uint64_t step = (hash >> 32) | 1;
+        return row * width + ((hash + row * step) & (width - 1));
+    }
+
+   public:
+    // width is rounded up to a power of two
+    count_min_sketch(size_t width, uint32_t depth);
+
+    // add `count` to the key and return its new estimate
+    uint64_t add(uint64_t hash, uint64_t count = 1) {
+        uint64_t smallest = UINT64_MAX;
+        for (uint32_t row = 0; row != depth; row++) {
+            uint64_t& c = cells[cell(hash, row)];
+            c += count;
+            smallest = c < smallest ? c : smallest;
+        }
+        return smallest;
+    }
+    uint64_t estimate(uint64_t hash) const;
+    // add the cells of a sketch of the same shape
+    void merge(const count_min_sketch& other);
+    size_t memory_bytes() const { return cells.size() * sizeof(uint64_t); }
+};
+
+/* the heavy hitters of a stream counted by a sketch: the `capacity` keys with
+the largest estimates so far. Estimates only grow, so a key whose estimate is
+below the smallest one kept is not kept either and costs a single compare,
+which is what almost every key of the long tail does. The counters form a
+min-heap, found by key through an open-addressing index on the key hash. */
+class heavy_hitters {
+   public:
+    struct counter {
+        std::string key;
+        uint64_t hash;
+        uint64_t count;
+        // slot of the counter in the index
+        size_t slot;
+    };
+
+    explicit heavy_hitters(size_t capacity);
+    // the key's estimate has grown to `estimate`
+    void offer(std::string_view key, uint64_t hash, uint64_t estimate) {
+        if (heap.size() == capacity && (capacity == 0 || estimate < heap[0].count))
+            return;
+        update(key, hash, estimate);
+    }
+    const std::vector<counter>& counters() const { return heap; }
+
+   private:
+    static constexpr uint32_t none = UINT32_MAX;
+
+    size_t capacity;
+    std::vector<counter> heap;
+    // heap position of the counter in each slot, `none` if empty
+    std::vector<uint32_t> index;
+
+    size_t home(uint64_t hash) const { return hash & (index.size() - 1); }
+    void place(size_t position);
+    void sift_up(size_t position);
+    void sift_down(size_t position);
+    void unlink(size_t slot);
+    void update(std::string_view key, uint64_t hash, uint64_t estimate);
+};
+}  // namespace wc
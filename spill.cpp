@@ -0,0 +1,104 @@
+#include "spill.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+bool wc::write_run(const counter_table& table, const fs::path& file) {
+    std::vector<sorted_entry> sorted;
+    sorted.reserve(table.size());
+    for (const counter_table::entry& e : table) sorted.emplace_back(e.key(), e.count);
+    std::sort(sorted.begin(), sorted.end());
+    store_writer writer(file, 0, 1);
+    for (const sorted_entry& entry : sorted) writer.add(entry.key, entry.count);
+    return writer.finish();
+}
+
+wc::spill_area::spill_area(const fs::path& dir, uint32_t num_partitions)
+    : dir(dir),
+      prefix("ngc-" + std::to_string(getpid()) + "-"),
+      partition_runs(num_partitions) {}
+
+wc::spill_area::~spill_area() {
+    std::error_code ec;
+    for (const auto& partition : partition_runs)
+        for (const fs::path& run : partition) fs::remove(run, ec);
+}
+
+fs::path wc::spill_area::new_file() {
+    return dir / (prefix + std::to_string(next_run++) + ".run");
+}
+
+fs::path wc::spill_area::spill(uint32_t partition, counter_table& table) {
+    fs::path file = new_file();
+    if (!write_run(table, file)) {
+        std::cerr << " * cannot spill to " << file.string() << std::endl;
+        std::exit(1);
+    }
+    table.clear();
+    std::lock_guard<std::mutex> lock(mtx);
+    partition_runs[partition].push_back(file);
+    return file;
+}
+
+std::vector<fs::path> wc::spill_area::runs(uint32_t partition) {
+    std::lock_guard<std::mutex> lock(mtx);
+    return partition_runs[partition];
+}
+
+std::vector<wc::sorted_entry> wc::run_sorter::sorted_pending() const {
+    std::vector<sorted_entry> sorted;
+    sorted.reserve(pending.size());
+    size_t begin = 0;
+    for (const auto& [end, count] : pending) {
+        sorted.emplace_back(std::string_view(pool).substr(begin, end - begin), count);
+        begin = end;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    return sorted;
+}
+
+void wc::run_sorter::flush() {
+    fs::path file = area.new_file();
+    store_writer writer(file, 0, 1);
+    for (const sorted_entry& entry : sorted_pending()) writer.add(entry.key, entry.count);
+    if (!writer.finish()) {
+        std::cerr << " * cannot spill to " << file.string() << std::endl;
+        std::exit(1);
+    }
+    runs.push_back(std::move(file));
+    pool.clear();
+    pending.clear();
+}
+
+void wc::run_sorter::add(std::string_view key, uint64_t count) {
+    pool.append(key);
+    pending.emplace_back(pool.size(), count);
+    if (pool.size() + pending.size() * sizeof(sorted_entry) >= budget)
+        flush();
+}
+
+bool wc::run_sorter::finish(store_writer& writer) {
+    if (runs.empty()) {
+        for (const sorted_entry& entry : sorted_pending()) writer.add(entry.key, entry.count);
+        return writer.finish();
+    }
+    if (!pending.empty())
+        flush();
+    std::vector<std::unique_ptr<store_reader>> readers;
+    std::vector<store_cursor> cursors;
+    for (const fs::path& run : runs) {
+        readers.push_back(std::make_unique<store_reader>(run, access_pattern::sequential));
+        cursors.emplace_back(*readers.back(), std::string_view());
+    }
+    sorted_merge merged(std::move(cursors));
+    std::string_view key;
+    uint64_t count;
+    while (merged.next(key, count)) writer.add(key, count);
+    std::error_code ec;
+    for (const fs::path& run : runs) fs::remove(run, ec);
+    return writer.finish();
+}
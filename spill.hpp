@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "count_store.hpp"
+#include "counter_table.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+// write the entries of `table` to `file` as a store file sorted by raw key
+bool write_run(const counter_table& table, const fs::path& file);
+// the memory `table` takes at its peak, while it is sorted into a run
+inline size_t spill_footprint(const counter_table& table) {
+    return table.memory_bytes() + table.size() * sizeof(sorted_entry);
+}
+
+/* the runs spilled by one count, grouped by the partition they belong to.
+Run files are named after the process and removed with the area. */
+class spill_area {
+    fs::path dir;
+    std::string prefix;
+    std::atomic<uint64_t> next_run{0};
+    std::mutex mtx;
+    std::vector<std::vector<fs::path>> partition_runs;
+
+   public:
+    spill_area(const fs::path& dir, uint32_t num_partitions);
+    ~spill_area();
+    spill_area(const spill_area&) = delete;
+    spill_area& operator=(const spill_area&) = delete;
+
+    // write `table` as a run of `partition`, clear it and return the run's
+    // file; exits on failure, counts that cannot be spilled cannot be kept
+    // either
+    fs::path spill(uint32_t partition, counter_table& table);
+    // a fresh file name in the area, for runs that are not partitions
+    fs::path new_file();
+    // a copy of the runs of `partition` spilled so far; they stay in the
+    // area, which removes them
+    std::vector<fs::path> runs(uint32_t partition);
+};
+
+/* sorts a stream of distinct keys under a byte budget: entries are gathered
+in memory and, whenever the budget is reached, sorted and spilled as a run,
+so that finish() only has to merge the runs */
+class run_sorter {
+    spill_area& area;
+    uint64_t budget;
+    std::string pool;
+    std::vector<std::pair<size_t, uint64_t>> pending;
+    std::vector<fs::path> runs;
+
+    std::vector<sorted_entry> sorted_pending() const;
+    void flush();
+
+   public:
+    run_sorter(spill_area& area, uint64_t budget) : area(area), budget(budget) {}
+    void add(std::string_view key, uint64_t count);
+    // every key added, in order, into `writer`
+    bool finish(store_writer& writer);
+};
+}  // namespace wc
@@ -0,0 +1,77 @@
+#include "store_merge.hpp"
+
+#include <algorithm>
+#include <thread>
+
+wc::store_merge::store_merge(const std::vector<fs::path>& dirs, uint32_t min_n,
+                             uint32_t n, size_t k)
+    : min_n(min_n), n(n), k(k) {
+    for (const fs::path& dir : dirs)
+        inputs.push_back(std::make_unique<count_store>(dir, access_pattern::sequential));
+}
+
+bool wc::store_merge::is_open() const {
+    return std::all_of(inputs.begin(), inputs.end(),
+                       [](const auto& input) { return input->is_open(); });
+}
+
+std::vector<std::string> wc::store_merge::splitters(uint32_t num_ranges) const {
+    // block keys are an even sample of every input, 64 entries apart
+    std::vector<std::string> keys;
+    for (const auto& input : inputs)
+        for (const auto& file : input->files()) file->block_keys(keys);
+    std::sort(keys.begin(), keys.end());
+    std::vector<std::string> cuts;
+    // a repeated cut makes an empty range, which is fine
+    for (uint32_t i = 1; i < num_ranges; i++)
+        cuts.push_back(keys.empty() ? std::string() : keys[keys.size() * i / num_ranges]);
+    return cuts;
+}
+
+bool wc::store_merge::merge_range(const fs::path& dir, uint32_t range,
+                                  uint32_t num_ranges, const std::string* from,
+                                  const std::string* to,
+                                  std::vector<std::vector<ranked_entry>>& tops) const {
+    std::vector<store_cursor> cursors;
+    for (const auto& input : inputs)
+        for (const auto& file : input->files())
+            cursors.emplace_back(*file, from == nullptr ? std::string_view() : *from);
+    sorted_merge merged(std::move(cursors), to);
+
+    store_writer writer(store_file(dir, range), range, num_ranges);
+    std::vector<top_k_heap> best(n - min_n + 1, top_k_heap(k));
+    std::string_view key;
+    uint64_t count;
+    while (merged.next(key, count)) {
+        writer.add(key, count);
+        uint32_t order = std::count(key.begin(), key.end(), ' ') + 1;
+        if (order >= min_n && order <= n)
+            best[order - min_n].push(key, count);
+    }
+    for (top_k_heap& heap : best) tops.push_back(heap.take());
+    return writer.finish();
+}
+
+bool wc::store_merge::write(const fs::path& dir, uint32_t num_ranges,
+                            std::vector<std::vector<ranked_entry>>& tops) const {
+    std::vector<std::string> cuts = splitters(num_ranges);
+    std::vector<std::vector<std::vector<ranked_entry>>> local_tops(num_ranges);
+    std::vector<char> written(num_ranges);
+    auto merge = [&](uint32_t range) {
+        const std::string* from = range == 0 ? nullptr : &cuts[range - 1];
+        const std::string* to = range + 1 == num_ranges ? nullptr : &cuts[range];
+        written[range] = merge_range(dir, range, num_ranges, from, to, local_tops[range]);
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < num_ranges; ++i) workers.push_back(std::thread(merge, i));
+    for (auto& worker : workers) worker.join();
+
+    // the ranges are disjoint, so their top k merge like the reducers' do
+    tops.clear();
+    for (uint32_t order = min_n; order <= n; order++) {
+        std::vector<std::vector<ranked_entry>> lists;
+        for (auto& local : local_tops) lists.push_back(std::move(local[order - min_n]));
+        tops.push_back(merge_top(std::move(lists), k));
+    }
+    return std::all_of(written.begin(), written.end(), [](char ok) { return ok; });
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "count_store.hpp"
+#include "top_k.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* sums the counts of several stores into a new one. Every partition file is
+sorted, so the key space is cut into ranges at block keys of the inputs and
+each thread k-way merges one range of every input into a partition file of
+its own, taking the top k of each order on the way. */
+class store_merge {
+    std::vector<std::unique_ptr<count_store>> inputs;
+    uint32_t min_n;
+    uint32_t n;
+    size_t k;
+
+    std::vector<std::string> splitters(uint32_t num_ranges) const;
+    bool merge_range(const fs::path& dir, uint32_t range, uint32_t num_ranges,
+                     const std::string* from, const std::string* to,
+                     std::vector<std::vector<ranked_entry>>& tops) const;
+
+   public:
+    store_merge(const std::vector<fs::path>& dirs, uint32_t min_n, uint32_t n,
+                size_t k);
+    // false if one of the input stores could not be opened
+    bool is_open() const;
+    /* write the sum of the inputs to `dir` as `num_ranges` partitions, and the
+    top k of every order from min_n to n to `tops`; false if a write failed */
+    bool write(const fs::path& dir, uint32_t num_ranges,
+               std::vector<std::vector<ranked_entry>>& tops) const;
+};
+}  // namespace wc
@@ -0,0 +1,223 @@
+#include "stream_counter.hpp"
+
+#include <algorithm>
+
+#include "decompress.hpp"
+#include "emit.hpp"
+
+namespace {
+// text waiting in the queue per worker before feeding blocks
+constexpr uint64_t queued_bytes_per_thread = 16 << 20;
+// the same for jobs of any kind, files are not read until a worker takes them
+constexpr size_t queued_jobs_per_thread = 64;
+
+// counts every n-gram into the table of its partition
+struct partition_adder {
+    std::vector<wc::counter_table>& subsets;
+
+    void add(std::string_view key, uint64_t hash, uint32_t) {
+        subsets[wc::partition_of(hash, subsets.size())].add(key, hash);
+    }
+};
+}  // namespace
+
+wc::ngram_counts::entry wc::ngram_counts::const_iterator::operator*() const {
+    std::string_view key = at->key();
+    return {key, at->count, uint32_t(std::count(key.begin(), key.end(), ' ') + 1)};
+}
+
+size_t wc::ngram_counts::size() const {
+    size_t total = 0;
+    for (const counter_table& table : tables) total += table.size();
+    return total;
+}
+
+uint64_t wc::ngram_counts::count(std::string_view ngram) const {
+    // the partitions are those of the counting keys, not of the text
+    uint64_t hash = hash_key(ngram);
+    for (const counter_table& table : tables)
+        if (uint64_t found = table.find(ngram, hash))
+            return found;
+    return 0;
+}
+
+std::vector<wc::ranked_entry> wc::ngram_counts::top(uint32_t order, size_t k) const {
+    std::vector<std::vector<ranked_entry>> lists;
+    for (const counter_table& table : tables)
+        lists.push_back(select_top(
+            table, k,
+            [order](const counter_table::entry& e) {
+                std::string_view key = e.key();
+                return uint32_t(std::count(key.begin(), key.end(), ' ') + 1) == order;
+            },
+            [](const counter_table::entry& e, std::string& text) { text = e.key(); }));
+    return merge_top(std::move(lists), k);
+}
+
+wc::stream_counter::stream_counter(const options& opts)
+    : min_n(lowest_order(opts)),
+      n(opts.n),
+      num_threads(std::max<uint32_t>(opts.num_threads, 1)),
+      keys(opts.keys),
+      text(opts.text),
+      // the read-ahead stage belongs to a batch count, these read in the workers
+      io(opts.io == io_mode::mmap ? io_mode::mmap : io_mode::stream),
+      chunk_size(opts.chunk_size),
+      merged(num_threads) {
+    workers.reserve(num_threads);
+    for (uint32_t i = 0; i != num_threads; i++) workers.emplace_back(vocab, num_threads);
+    for (uint32_t i = 0; i != num_threads; i++) pool.emplace_back(&stream_counter::work, this, i);
+}
+
+wc::stream_counter::~stream_counter() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (std::thread& t : pool) t.join();
+}
+
+void wc::stream_counter::push(job&& j) {
+    std::unique_lock<std::mutex> lock(mtx);
+    finished.wait(lock, [this] {
+        return !merging && queued_bytes <= queued_bytes_per_thread * num_threads &&
+               jobs.size() <= queued_jobs_per_thread * num_threads;
+    });
+    queued_bytes += j.bytes.size();
+    unfinished++;
+    jobs.push_back(std::move(j));
+    lock.unlock();
+    queued.notify_one();
+}
+
+void wc::stream_counter::feed(std::string_view text) {
+    job j{job::text};
+    j.bytes.assign(text);
+    push(std::move(j));
+}
+
+void wc::stream_counter::feed_file(const fs::path& file) {
+    std::error_code ec;
+    uint64_t size = fs::file_size(file, ec);
+    if (ec)
+        size = 0;
+    if (compression_of(file) != compression::none || chunk_size == 0 || size <= chunk_size) {
+        job j{job::file};
+        j.item = {file, 0, work_item::whole_file, size};
+        push(std::move(j));
+        return;
+    }
+    // chunks are cut as in a batch count, each one a job
+    for (uint64_t offset = 0; offset < size; offset += chunk_size) {
+        job j{job::file};
+        j.item = {file, offset, chunk_size, std::min(chunk_size, size - offset)};
+        push(std::move(j));
+    }
+}
+
+void wc::stream_counter::work(uint32_t id) {
+    worker_state& state = workers[id];
+    partition_adder sink{state.subsets};
+    auto count = [&](std::string_view text) {
+        state.stats.bytes_read += text.size();
+        if (this->text == text_mode::utf8) {
+            if (keys == key_mode::ids)
+                emit_ids<utf8_tokenizer>(text, min_n, n, sink, state.words, state.stats);
+            else
+                emit_text<utf8_tokenizer>(text, min_n, n, sink, state.stats);
+        } else if (keys == key_mode::ids) {
+            emit_ids(text, min_n, n, sink, state.words, state.stats);
+        } else {
+            emit_text(text, min_n, n, sink, state.stats);
+        }
+    };
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mtx);
+        queued.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+        job j = std::move(jobs.front());
+        jobs.pop_front();
+        queued_bytes -= j.bytes.size();
+        lock.unlock();
+        // a queue that drained is room for a waiting feed
+        finished.notify_all();
+
+        if (j.kind == job::text) {
+            count(j.bytes);
+        } else if (j.kind == job::file) {
+            compression c = compression_of(j.item.path);
+            if (c == compression::none)
+                count(file_input(j.item, io).text());
+            else
+                decompress(j.item.path, c, count);
+        } else {
+            reduce(j.partition);
+        }
+
+        lock.lock();
+        bool idle = --unfinished == 0;
+        lock.unlock();
+        if (idle)
+            finished.notify_all();
+    }
+}
+
+void wc::stream_counter::reduce(uint32_t partition) {
+    // every worker is idle or reducing another partition, so their tables
+    // and the vocabulary hold still
+    counter_table& out = merged[partition];
+    std::string text;
+    for (worker_state& state : workers) {
+        counter_table& subset = state.subsets[partition];
+        if (keys == key_mode::ids) {
+            for (const counter_table::entry& e : subset) {
+                text.clear();
+                vocab.decode(e.key(), text);
+                out.add(text, hash_key(text), e.count);
+            }
+            if (taking)
+                subset.clear();
+        } else if (taking) {
+            out.merge(std::move(subset));
+            subset.clear();
+        } else {
+            for (const counter_table::entry& e : subset) out.add(e.key(), e.hash, e.count);
+        }
+    }
+}
+
+wc::ngram_counts wc::stream_counter::merge(bool take) {
+    std::lock_guard<std::mutex> control(control_mtx);
+    std::unique_lock<std::mutex> lock(mtx);
+    // close feeding, let what was fed finish, then reduce on the pool
+    merging = true;
+    finished.wait(lock, [this] { return unfinished == 0; });
+    taking = take;
+    for (uint32_t p = 0; p != num_threads; p++) {
+        job j{job::reduce};
+        j.partition = p;
+        unfinished++;
+        jobs.push_back(std::move(j));
+    }
+    queued.notify_all();
+    finished.wait(lock, [this] { return unfinished == 0; });
+    // the reduce decoded every id to text, so a counter that starts over
+    // starts its vocabulary over too instead of keeping every word it saw
+    if (take && keys == key_mode::ids) {
+        vocab.clear();
+        for (worker_state& state : workers) state.words.clear();
+    }
+
+    std::vector<counter_table> tables(num_threads);
+    tables.swap(merged);
+    merging = false;
+    lock.unlock();
+    finished.notify_all();
+    return ngram_counts(std::move(tables));
+}
+
+wc::ngram_counts wc::stream_counter::snapshot() { return merge(false); }
+
+wc::ngram_counts wc::stream_counter::finalize() { return merge(true); }
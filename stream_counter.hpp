@@ -0,0 +1,156 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "counter_table.hpp"
+#include "file_input.hpp"
+#include "n-gram_counter.hpp"
+#include "run_stats.hpp"
+#include "top_k.hpp"
+#include "vocabulary.hpp"
+
+namespace fs = std::filesystem;
+
+namespace wc {
+/* merged counts out of a stream_counter: every n-gram by its text, its words
+folded and joined by a space as in a store. The keys are spread over a
+table per partition of the counter, each key in one of them. */
+class ngram_counts {
+   public:
+    struct entry {
+        std::string_view ngram;
+        uint64_t count;
+        uint32_t order;
+    };
+
+    class const_iterator {
+        const std::vector<counter_table>* tables;
+        size_t table;
+        counter_table::const_iterator at;
+
+        void skip_empty() {
+            while (table != tables->size() && at == (*tables)[table].end()) {
+                if (++table != tables->size())
+                    at = (*tables)[table].begin();
+            }
+        }
+
+       public:
+        const_iterator(const std::vector<counter_table>* tables, size_t table)
+            : tables(tables),
+              table(table),
+              at(table == tables->size() ? counter_table::const_iterator(nullptr, nullptr, nullptr)
+                                         : (*tables)[table].begin()) {
+            skip_empty();
+        }
+        entry operator*() const;
+        const_iterator& operator++() {
+            ++at;
+            skip_empty();
+            return *this;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return table != other.table || (table != tables->size() && at != other.at);
+        }
+    };
+
+    ngram_counts() = default;
+    explicit ngram_counts(std::vector<counter_table>&& tables) : tables(std::move(tables)) {}
+
+    size_t size() const;
+    // the count of an n-gram in stored form, 0 if it was never seen
+    uint64_t count(std::string_view ngram) const;
+    // the k most frequent n-grams of `order`, ranked
+    std::vector<ranked_entry> top(uint32_t order, size_t k) const;
+
+    const_iterator begin() const { return {&tables, 0}; }
+    const_iterator end() const { return {&tables, tables.size()}; }
+
+   private:
+    std::vector<counter_table> tables;
+};
+
+/* n-gram counting as a library, for a program that keeps feeding text. Any
+number of threads may feed texts and files; a pool of opts.num_threads
+workers, started once, tokenizes them and counts into tables of their own.
+snapshot() and finalize() wait for everything fed before them, then merge
+the workers' tables in parallel, the workers reducing a partition each.
+Nothing is printed. Of the options, only the orders, the threads, keys, text, io
+(stream or mmap) and chunk_size apply. */
+class stream_counter {
+   public:
+    explicit stream_counter(const options& opts);
+    ~stream_counter();
+    stream_counter(const stream_counter&) = delete;
+    stream_counter& operator=(const stream_counter&) = delete;
+
+    // count a text, copied before this returns; no n-gram spans two feeds
+    void feed(std::string_view text);
+    // count a file, split into chunks of chunk_size unless it is compressed;
+    // a file that cannot be read or decoded counts as far as it could be
+    void feed_file(const fs::path& file);
+    // the counts of everything fed so far; counting goes on from there
+    ngram_counts snapshot();
+    // the same, and the counter starts over empty, its vocabulary included
+    ngram_counts finalize();
+
+   private:
+    struct job {
+        enum kind_t { text, file, reduce };
+        explicit job(kind_t kind) : kind(kind) {}
+        kind_t kind;
+        std::string bytes;
+        work_item item;
+        uint32_t partition = 0;
+    };
+    struct worker_state {
+        explicit worker_state(vocabulary& vocab, uint32_t num_partitions)
+            : subsets(num_partitions), words(vocab) {}
+        std::vector<counter_table> subsets;
+        word_cache words;
+        thread_stats stats;
+    };
+
+    uint32_t min_n;
+    uint32_t n;
+    uint32_t num_threads;
+    key_mode keys;
+    text_mode text;
+    io_mode io;
+    uint64_t chunk_size;
+    vocabulary vocab;
+    std::vector<worker_state> workers;
+
+    std::mutex mtx;
+    // a job was queued, or the pool is stopping
+    std::condition_variable queued;
+    // a job was finished, or feeding may go on
+    std::condition_variable finished;
+    std::deque<job> jobs;
+    // bytes of the texts in `jobs`, feeding waits while there are too many
+    uint64_t queued_bytes = 0;
+    // jobs queued or running
+    uint64_t unfinished = 0;
+    // while merging, feeding waits
+    bool merging = false;
+    bool stopping = false;
+    // what the reduce jobs build, and whether they may take the tables
+    std::vector<counter_table> merged;
+    bool taking = false;
+    std::mutex control_mtx;
+    std::vector<std::thread> pool;
+
+    void push(job&& j);
+    void work(uint32_t id);
+    void reduce(uint32_t partition);
+    ngram_counts merge(bool take);
+};
+}  // namespace wc
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "char_class.hpp"
+
+namespace wc {
+/* walks a text buffer once and hands out its words as views into the buffer.
+The buffer is never modified: words keep their original case and are folded
+by whoever builds a key from them. The text is classified 64 bytes at a time
+into bit masks, and word starts and sentence breaks are found by counting
+trailing zeros, so there is no branch per byte. */
+class tokenizer {
+    const char* data;
+    size_t size;
+    // offset of the block the masks describe
+    size_t block = 0;
+    char_masks masks{0, 0};
+    // word starts and sentence breaks of the block not handed out yet
+    uint64_t events = 0;
+
+    void load(size_t at) {
+        uint64_t carry = masks.letters >> 63;
+        block = at;
+        masks = classify_block(data + at, std::min<size_t>(64, size - at));
+        events = (masks.letters & ~(masks.letters << 1 | carry)) | masks.breaks;
+    }
+
+   public:
+    enum token_type { word, sentence_end, done };
+
+    explicit tokenizer(std::string_view text)
+        : data(text.data()), size(text.size()) {
+        if (size != 0)
+            load(0);
+    }
+
+    // advance to the next word or sentence break; `token` is only set for words
+    token_type next(std::string_view& token) {
+        while (events == 0) {
+            if (block + 64 >= size)
+                return done;
+            load(block + 64);
+        }
+        unsigned bit = __builtin_ctzll(events);
+        events &= events - 1;
+        if (masks.breaks >> bit & 1)
+            return sentence_end;
+        size_t start = block + bit;
+        // the word ends at the first non-letter, which may be blocks away
+        uint64_t rest = ~masks.letters & (~0ull << bit);
+        while (rest == 0 && block + 64 < size) {
+            load(block + 64);
+            rest = ~masks.letters;
+        }
+        size_t stop = rest == 0 ? size : block + __builtin_ctzll(rest);
+        token = std::string_view(data + start, stop - start);
+        return word;
+    }
+};
+}  // namespace wc
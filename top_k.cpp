@@ -0,0 +1,24 @@
+#include "top_k.hpp"
+
+std::vector<wc::ranked_entry> wc::merge_top(
+    std::vector<std::vector<ranked_entry>>&& lists, size_t k) {
+    // heads of the lists, as (list, position), the best head on top
+    using head_t = std::pair<size_t, size_t>;
+    auto worse = [&lists](const head_t& a, const head_t& b) {
+        return ranks_before(lists[b.first][b.second], lists[a.first][a.second]);
+    };
+    std::priority_queue<head_t, std::vector<head_t>, decltype(worse)> heads(worse);
+    for (size_t i = 0; i != lists.size(); i++) {
+        if (!lists[i].empty())
+            heads.push({i, 0});
+    }
+    std::vector<ranked_entry> merged;
+    while (!heads.empty() && merged.size() != k) {
+        auto [list, pos] = heads.top();
+        heads.pop();
+        merged.push_back(std::move(lists[list][pos]));
+        if (pos + 1 != lists[list].size())
+            heads.push({list, pos + 1});
+    }
+    return merged;
+}
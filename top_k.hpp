@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace wc {
+// an n-gram as printed: its text and its count
+using ranked_entry = std::pair<std::string, uint64_t>;
+
+// the ranking of the output: decreasing count, ties in increasing text order
+inline bool ranks_before(const ranked_entry& p1, const ranked_entry& p2) {
+    return p1.second > p2.second ||
+           (p1.second == p2.second && p1.first < p2.first);
+}
+
+// the k best of a stream of entries, copying only those that make the cut
+class top_k_heap {
+    size_t k;
+    // the worst kept entry sits on top
+    std::priority_queue<ranked_entry, std::vector<ranked_entry>,
+                        decltype(&ranks_before)>
+        best;
+
+   public:
+    explicit top_k_heap(size_t k) : k(k), best(&ranks_before) {}
+
+    // whether an entry with `count` could be kept, before building its key
+    bool may_take(uint64_t count) const {
+        return k != 0 && (best.size() < k || count >= best.top().second);
+    }
+
+    void push(std::string_view key, uint64_t count) {
+        if (k == 0)
+            return;
+        if (best.size() == k) {
+            const ranked_entry& worst = best.top();
+            if (count < worst.second || (count == worst.second && key >= worst.first))
+                return;
+            best.pop();
+        }
+        best.emplace(std::string(key), count);
+    }
+
+    // the kept entries, ranked; the heap is left empty
+    std::vector<ranked_entry> take() {
+        std::vector<ranked_entry> result(best.size());
+        for (size_t i = result.size(); i != 0; i--) {
+            result[i - 1] = best.top();
+            best.pop();
+        }
+        return result;
+    }
+};
+
+/* the k best entries of `table` for which `keep(entry)` holds, ranked. The
+first pass keeps a heap of the k largest counts to find the smallest count
+that can make the cut; the second decodes only the entries reaching it into
+a top_k_heap, so neither pass copies the table. */
+template <class Table, class Keep, class Decode>
+std::vector<ranked_entry> select_top(const Table& table, size_t k, Keep keep,
+                                     Decode decode) {
+    if (k == 0)
+        return {};
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>>
+        counts;
+    for (const auto& e : table) {
+        if (!keep(e))
+            continue;
+        if (counts.size() < k)
+            counts.push(e.count);
+        else if (e.count > counts.top()) {
+            counts.pop();
+            counts.push(e.count);
+        }
+    }
+    if (counts.empty())
+        return {};
+    uint64_t threshold = counts.size() < k ? 0 : counts.top();
+
+    top_k_heap best(k);
+    std::string text;
+    for (const auto& e : table) {
+        if (e.count < threshold || !keep(e))
+            continue;
+        text.clear();
+        decode(e, text);
+        best.push(text, e.count);
+    }
+    return best.take();
+}
+
+// k-way merge of ranked lists over disjoint keys into the k best overall
+std::vector<ranked_entry> merge_top(std::vector<std::vector<ranked_entry>>&& lists,
+                                    size_t k);
+}  // namespace wc
@@ -0,0 +1,154 @@
+#include "utf8.hpp"
+
+namespace {
+struct cp_range {
+    uint32_t first;
+    uint32_t last;
+    wc::cp_class cls;
+};
+
+using wc::cp_class;
+constexpr cp_class L = cp_class::letter;
+constexpr cp_class B = cp_class::sentence_break;
+constexpr cp_class S = cp_class::separator;
+constexpr cp_class I = cp_class::ideograph;
+
+/* the classes of the plane, applied in order so that a later range refines
+an earlier one; anything not listed separates words. Letters include the
+combining marks, which belong to the word they follow; digits of any script
+and punctuation end a sentence, as in ascii mode. */
+const cp_range bmp_ranges[] = {
+    // Latin-1 punctuation and signs, but ª µ º are letters
+    {0x00A1, 0x00BF, B}, {0x00AA, 0x00AA, L}, {0x00B5, 0x00B5, L}, {0x00BA, 0x00BA, L},
+    // Latin-1 letters, Latin Extended A and B, IPA, modifiers, combining marks
+    {0x00C0, 0x036F, L}, {0x00D7, 0x00D7, B}, {0x00F7, 0x00F7, B},
+    // Greek and Coptic, Cyrillic, Armenian, Hebrew
+    {0x0370, 0x058F, L}, {0x037E, 0x037E, B}, {0x0387, 0x0387, B}, {0x0482, 0x0482, B},
+    {0x0589, 0x058A, B}, {0x0590, 0x05FF, L}, {0x05BE, 0x05BE, B}, {0x05C0, 0x05C0, B},
+    {0x05C3, 0x05C3, B}, {0x05F3, 0x05F4, B},
+    // Arabic, Syriac, Thaana and on to the Indic scripts, Thai, Lao, Tibetan,
+    // Myanmar, Georgian, Hangul Jamo, Ethiopic, Cherokee, Khmer, Mongolian
+    {0x0600, 0x18AF, L}, {0x060C, 0x060D, B}, {0x061B, 0x061B, B}, {0x061F, 0x061F, B},
+    {0x0660, 0x066D, B}, {0x06D4, 0x06D4, B}, {0x06F0, 0x06F9, B}, {0x0964, 0x096F, B},
+    {0x09E6, 0x09EF, B}, {0x0A66, 0x0A6F, B}, {0x0AE6, 0x0AEF, B}, {0x0B66, 0x0B6F, B},
+    {0x0BE6, 0x0BEF, B}, {0x0C66, 0x0C6F, B}, {0x0CE6, 0x0CEF, B}, {0x0D66, 0x0D6F, B},
+    {0x0E50, 0x0E59, B}, {0x0ED0, 0x0ED9, B}, {0x0F20, 0x0F33, B}, {0x1040, 0x1049, B},
+    {0x104A, 0x104F, B}, {0x10FB, 0x10FB, B}, {0x1360, 0x1368, B}, {0x1369, 0x137C, B},
+    {0x166D, 0x166E, B}, {0x1680, 0x1680, S}, {0x17D4, 0x17DA, B}, {0x17E0, 0x17E9, B},
+    {0x1800, 0x180A, B}, {0x1810, 0x1819, B},
+    // the scripts of Southeast Asia up to Sundanese, phonetic extensions and
+    // more combining marks
+    {0x18B0, 0x1DFF, L}, {0x1946, 0x194F, B}, {0x19D0, 0x19D9, B}, {0x1A80, 0x1A99, B},
+    {0x1B50, 0x1B59, B}, {0x1BB0, 0x1BB9, B}, {0x1C40, 0x1C49, B}, {0x1C50, 0x1C59, B},
+    // Latin Extended Additional (Vietnamese) and Greek Extended
+    {0x1E00, 0x1FFF, L},
+    // spaces, joiners inside words, dashes and quotes, more spaces, symbols
+    {0x2000, 0x200B, S}, {0x200C, 0x200D, L}, {0x2010, 0x2027, B}, {0x2028, 0x202F, S},
+    {0x2030, 0x205E, B}, {0x205F, 0x206F, S},
+    // super and subscripts, currency, letter-like symbols, number forms,
+    // arrows, math, technical, boxes, dingbats
+    {0x2070, 0x2BFF, B},
+    // Glagolitic, Latin Extended C, Coptic, Georgian Supplement, Tifinagh,
+    // Ethiopic Extended, Cyrillic Extended A
+    {0x2C00, 0x2DFF, L}, {0x2E00, 0x2E7F, B},
+    // CJK radicals, ideographic space and punctuation, kana, bopomofo,
+    // Hangul compatibility jamo, CJK strokes, enclosed letters, compatibility
+    {0x2E80, 0x2FDF, I}, {0x3000, 0x3000, S}, {0x3001, 0x303F, B}, {0x3005, 0x3007, I},
+    {0x3021, 0x3029, I}, {0x3031, 0x3035, I}, {0x3040, 0x30FF, I}, {0x30FB, 0x30FB, B},
+    {0x3100, 0x312F, I}, {0x3130, 0x318F, L}, {0x3190, 0x31FF, I}, {0x3200, 0x33FF, B},
+    // CJK Extension A, unified ideographs, Yi
+    {0x3400, 0x4DBF, I}, {0x4DC0, 0x4DFF, B}, {0x4E00, 0x9FFF, I}, {0xA000, 0xA4CF, I},
+    // Lisu to Latin Extended D and E, scripts of Southeast Asia
+    {0xA4D0, 0xABFF, L}, {0xA60D, 0xA60F, B}, {0xA620, 0xA629, B}, {0xA673, 0xA673, B},
+    {0xA6F2, 0xA6F7, B},
+    // Hangul syllables and jamo; CJK compatibility ideographs
+    {0xAC00, 0xD7FF, L}, {0xF900, 0xFAFF, I},
+    // presentation forms of Latin, Armenian, Hebrew and Arabic
+    {0xFB00, 0xFDFF, L}, {0xFD3E, 0xFD3F, B}, {0xFE00, 0xFE0F, L},
+    // vertical, compatibility and small forms of CJK punctuation
+    {0xFE10, 0xFE6F, B}, {0xFE70, 0xFEFE, L},
+    // fullwidth ascii, halfwidth katakana and hangul
+    {0xFF01, 0xFF65, B}, {0xFF21, 0xFF3A, L}, {0xFF41, 0xFF5A, L}, {0xFF66, 0xFF9F, I},
+    {0xFFA0, 0xFFDC, L},
+};
+
+std::array<cp_class, 0x10000> make_bmp_classes() {
+    std::array<cp_class, 0x10000> classes{};
+    for (uint32_t c = 0; c != 0x80; c++) classes[c] = cp_class(wc::classify((char) c));
+    for (const cp_range& r : bmp_ranges)
+        for (uint32_t c = r.first; c <= r.last; c++) classes[c] = r.cls;
+    return classes;
+}
+
+// whether `cp` in [first, last] is the capital of an even/odd pair
+bool even_capital(uint32_t cp, uint32_t first, uint32_t last) {
+    return cp >= first && cp <= last && (cp & 1) == (first & 1);
+}
+}  // namespace
+
+const std::array<wc::cp_class, 0x10000> wc::detail::bmp_classes = make_bmp_classes();
+
+uint32_t wc::fold_codepoint(uint32_t cp) {
+    if (cp < 0x80)
+        return (unsigned char) fold((char) cp);
+    // Latin-1, but not the multiplication sign
+    if (cp >= 0x00C0 && cp <= 0x00DE && cp != 0x00D7)
+        return cp + 0x20;
+    if (cp == 0x0130)
+        return 'i';
+    if (cp == 0x0178)
+        return 0x00FF;
+    // Latin Extended A and B, pairs of a capital and its small letter
+    if (even_capital(cp, 0x0100, 0x012F) || even_capital(cp, 0x0132, 0x0137) ||
+        even_capital(cp, 0x0139, 0x0148) || even_capital(cp, 0x014A, 0x0177) ||
+        even_capital(cp, 0x0179, 0x017E) || even_capital(cp, 0x01CD, 0x01DC) ||
+        even_capital(cp, 0x01DE, 0x01EF) || even_capital(cp, 0x01F8, 0x021F) ||
+        even_capital(cp, 0x0222, 0x0233))
+        return cp + 1;
+    // Greek
+    if (cp >= 0x0391 && cp <= 0x03AB && cp != 0x03A2)
+        return cp + 0x20;
+    if (cp == 0x0386)
+        return 0x03AC;
+    if (cp >= 0x0388 && cp <= 0x038A)
+        return cp + 0x25;
+    if (cp == 0x038C)
+        return 0x03CC;
+    if (cp == 0x038E || cp == 0x038F)
+        return cp + 0x3F;
+    if (even_capital(cp, 0x03D8, 0x03EF))
+        return cp + 1;
+    // Cyrillic
+    if (cp >= 0x0400 && cp <= 0x040F)
+        return cp + 0x50;
+    if (cp >= 0x0410 && cp <= 0x042F)
+        return cp + 0x20;
+    if (even_capital(cp, 0x0460, 0x0481) || even_capital(cp, 0x048A, 0x04BF) ||
+        even_capital(cp, 0x04D0, 0x052F))
+        return cp + 1;
+    if (cp == 0x04C0)
+        return 0x04CF;
+    if (even_capital(cp, 0x04C1, 0x04CE))
+        return cp + 1;
+    // Armenian
+    if (cp >= 0x0531 && cp <= 0x0556)
+        return cp + 0x30;
+    // Latin Extended Additional, Vietnamese among it, and fullwidth Latin
+    if (even_capital(cp, 0x1E00, 0x1E95) || even_capital(cp, 0x1EA0, 0x1EFF))
+        return cp + 1;
+    if (cp >= 0xFF21 && cp <= 0xFF3A)
+        return cp + 0x20;
+    return cp;
+}
+
+void wc::append_folded_utf8(std::string& out, std::string_view word) {
+    for (size_t i = 0; i < word.size();) {
+        uint32_t length;
+        uint32_t cp = decode_utf8(word.data() + i, word.size() - i, length);
+        if (cp == 0xFFFD && length == 1 && (unsigned char) word[i] >= 0x80)
+            out.push_back(word[i]);
+        else
+            append_utf8(out, fold_codepoint(cp));
+        i += length;
+    }
+}
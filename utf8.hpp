@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "char_class.hpp"
+
+namespace wc {
+// how the bytes of a text are split into words
+enum class text_mode {
+    // ascii letters form words, every other byte above 0x7f separates them
+    ascii,
+    // codepoints of UTF-8 text: letters of any script form words, and an
+    // ideograph or kana is a word on its own, as these scripts have no spaces
+    utf8
+};
+
+// classes of a codepoint in utf8 mode, extending char_class
+enum class cp_class : uint8_t { separator, letter, sentence_break, ideograph };
+
+namespace detail {
+// the class of every codepoint of the basic multilingual plane
+extern const std::array<cp_class, 0x10000> bmp_classes;
+}  // namespace detail
+
+inline cp_class classify_codepoint(uint32_t cp) {
+    if (cp < 0x10000)
+        return detail::bmp_classes[cp];
+    // the supplementary ideographic planes, emoji and symbols, and the
+    // historic scripts and letter-like math of the rest of plane 1
+    if (cp >= 0x20000 && cp < 0x40000)
+        return cp_class::ideograph;
+    if (cp >= 0x1F000)
+        return cp_class::separator;
+    return cp_class::letter;
+}
+
+/* the codepoint at `p`, which has `avail` > 0 bytes after it; sets `length`
+to its bytes. A byte that does not start a well-formed sequence (a stray
+continuation byte, a truncated or overlong sequence, a surrogate) decodes as
+a one-byte separator, U+FFFD, so broken text never becomes a word. */
+inline uint32_t decode_utf8(const char* p, size_t avail, uint32_t& length) {
+    const unsigned char* s = reinterpret_cast<const unsigned char*>(p);
+    length = 1;
+    if (s[0] < 0x80)
+        return s[0];
+    uint32_t need, cp, min;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        need = 2, cp = s[0] & 0x1F, min = 0x80;
+    } else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        need = 3, cp = s[0] & 0x0F, min = 0x800;
+    } else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        need = 4, cp = s[0] & 0x07, min = 0x10000;
+    } else {
+        return 0xFFFD;
+    }
+    if (avail < need)
+        return 0xFFFD;
+    for (uint32_t i = 1; i != need; i++) {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0xFFFD;
+        cp = cp << 6 | (s[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        return 0xFFFD;
+    length = need;
+    return cp;
+}
+
+// the lowercase of a codepoint for the scripts with case: Latin, Greek,
+// Cyrillic, Armenian and the fullwidth forms
+uint32_t fold_codepoint(uint32_t cp);
+
+inline void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back((char) cp);
+    } else if (cp < 0x800) {
+        out.push_back((char) (0xC0 | cp >> 6));
+        out.push_back((char) (0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back((char) (0xE0 | cp >> 12));
+        out.push_back((char) (0x80 | (cp >> 6 & 0x3F)));
+        out.push_back((char) (0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back((char) (0xF0 | cp >> 18));
+        out.push_back((char) (0x80 | (cp >> 12 & 0x3F)));
+        out.push_back((char) (0x80 | (cp >> 6 & 0x3F)));
+        out.push_back((char) (0x80 | (cp & 0x3F)));
+    }
+}
+
+/* the tokenizer of utf8 mode, with the interface and the 64-byte masks of
+tokenizer. A block without a byte above 0x7f, the common case even in most
+accented text, is classified by the same vector code; any other block is
+decoded a codepoint at a time through the class table. A codepoint may run
+into the next block, its class is carried over. Ideographs start a word at
+each codepoint, through a mask of forced word starts. */
+class utf8_tokenizer {
+    const char* data;
+    size_t size;
+    size_t block = 0;
+    // every byte of a letter or ideograph, the first byte of a break, and
+    // word starts that are not at the end of a run of non-letters
+    uint64_t letters = 0;
+    uint64_t breaks = 0;
+    uint64_t cuts = 0;
+    uint64_t events = 0;
+    // the codepoint running past the end of the block: bytes left, class
+    uint32_t pending = 0;
+    cp_class pending_class = cp_class::separator;
+    // the last codepoint of the block was an ideograph
+    bool after_ideograph = false;
+
+    static bool all_ascii(const char* p, size_t len) {
+        uint64_t high = 0;
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, p + i, 8);
+            high |= word;
+        }
+        for (; i != len; i++) high |= (unsigned char) p[i];
+        return (high & 0x8080808080808080ull) == 0;
+    }
+
+    void classify_mixed(size_t len) {
+        letters = breaks = cuts = 0;
+        const char* p = data + block;
+        size_t i = 0;
+        // the tail of a codepoint begun in the block before
+        for (; i != len && pending != 0; i++, pending--)
+            if (pending_class == cp_class::letter || pending_class == cp_class::ideograph)
+                letters |= 1ull << i;
+        while (i < len) {
+            uint32_t length;
+            cp_class cls = classify_codepoint(decode_utf8(p + i, size - block - i, length));
+            if (cls == cp_class::letter || cls == cp_class::ideograph) {
+                letters |= ((1ull << length) - 1) << i;
+                if (cls == cp_class::ideograph || after_ideograph)
+                    cuts |= 1ull << i;
+            } else if (cls == cp_class::sentence_break) {
+                breaks |= 1ull << i;
+            }
+            after_ideograph = cls == cp_class::ideograph;
+            if (i + length > len) {
+                pending = i + length - len;
+                pending_class = cls;
+            }
+            i += length;
+        }
+    }
+
+    void load(size_t at) {
+        uint64_t carry = letters >> 63;
+        block = at;
+        size_t len = std::min<size_t>(64, size - at);
+        if (pending == 0 && all_ascii(data + at, len)) {
+            char_masks masks = classify_block(data + at, len);
+            letters = masks.letters;
+            breaks = masks.breaks;
+            cuts = after_ideograph ? letters & 1 : 0;
+            after_ideograph = false;
+        } else {
+            classify_mixed(len);
+        }
+        events = (letters & ~(letters << 1 | carry)) | cuts | breaks;
+    }
+
+   public:
+    enum token_type { word, sentence_end, done };
+
+    explicit utf8_tokenizer(std::string_view text) : data(text.data()), size(text.size()) {
+        if (size != 0)
+            load(0);
+    }
+
+    token_type next(std::string_view& token) {
+        while (events == 0) {
+            if (block + 64 >= size)
+                return done;
+            load(block + 64);
+        }
+        unsigned bit = __builtin_ctzll(events);
+        events &= events - 1;
+        if (breaks >> bit & 1)
+            return sentence_end;
+        size_t start = block + bit;
+        // the word ends at the first non-letter or forced start after it
+        uint64_t rest = (~letters | cuts) & (~0ull << bit) & ~(1ull << bit);
+        while (rest == 0 && block + 64 < size) {
+            load(block + 64);
+            rest = ~letters | cuts;
+        }
+        size_t stop = rest == 0 ? size : block + __builtin_ctzll(rest);
+        token = std::string_view(data + start, stop - start);
+        return word;
+    }
+};
+}  // namespace wc
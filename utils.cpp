@@ -1,20 +1,127 @@
 #include "utils.hpp"
 
-#include <list>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 std::vector<fs::path> utils::find_all_files(
-    const fs::path& dir, std::function<bool(const std::string&)> pred) {
-    std::list<fs::path> files_to_sweep;
-    // iterate recursively to find all files that satisfy pred
-    for (auto& entry : fs::recursive_directory_iterator(dir)) {
-        if (entry.is_regular_file()) {
-            fs::path cur_file = entry.path();
-            std::string type(cur_file.extension());
-            if (pred(type)) {
-                files_to_sweep.push_back(std::move(cur_file));
+    const fs::path& dir, std::function<bool(const std::string&)> pred,
+    uint32_t num_scanners, bool* readable) {
+    std::mutex mtx;
+    std::vector<fs::path> files;
+    bool read = scan_files(dir, pred, num_scanners, [&mtx, &files](fs::path&& file) {
+        std::lock_guard<std::mutex> lock(mtx);
+        files.push_back(std::move(file));
+    });
+    if (readable)
+        *readable = read;
+    return files;
+}
+
+bool utils::scan_files(const fs::path& dir, std::function<bool(const std::string&)> pred,
+                       uint32_t num_scanners, std::function<void(fs::path&&)> on_file) {
+    // directories waiting to be listed, and scanners listing one; the walk
+    // is over when both are zero
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<fs::path> pending{dir};
+    uint32_t busy = 0;
+    bool root_read = true;
+
+    auto scan = [&]() {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;) {
+            cv.wait(lock, [&] { return !pending.empty() || busy == 0; });
+            if (pending.empty())
+                return;
+            fs::path current = std::move(pending.back());
+            pending.pop_back();
+            busy++;
+            lock.unlock();
+
+            std::vector<fs::path> subdirs;
+            std::error_code ec;
+            fs::directory_iterator it(current, fs::directory_options::skip_permission_denied, ec);
+            bool readable = !ec;
+            for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+                const fs::directory_entry& entry = *it;
+                std::error_code type_ec;
+                // like a recursive_directory_iterator, links to directories
+                // are not followed but links to files are
+                if (entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+                    subdirs.push_back(entry.path());
+                } else if (entry.is_regular_file(type_ec)) {
+                    fs::path file = entry.path();
+                    if (pred(file.filename().string()))
+                        on_file(std::move(file));
+                }
             }
+
+            lock.lock();
+            if (!readable && current == dir)
+                root_read = false;
+            for (fs::path& subdir : subdirs) pending.push_back(std::move(subdir));
+            busy--;
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> scanners;
+    for (uint32_t i = 1; i < num_scanners; i++) scanners.push_back(std::thread(scan));
+    scan();
+    for (auto& scanner : scanners) scanner.join();
+    return root_read;
+}
+
+uint64_t utils::parse_size(const std::string& text) {
+    size_t pos = 0;
+    uint64_t value = std::stoull(text, &pos);
+    std::string suffix = text.substr(pos);
+    if (suffix.empty())
+        return value;
+    if (suffix.size() == 1 || suffix.substr(1) == "B" || suffix.substr(1) == "iB") {
+        switch (suffix[0]) {
+            case 'k':
+            case 'K':
+                return value << 10;
+            case 'm':
+            case 'M':
+                return value << 20;
+            case 'g':
+            case 'G':
+                return value << 30;
+            case 't':
+            case 'T':
+                return value << 40;
+        }
+    }
+    throw std::invalid_argument("bad size: " + text);
+}
+
+uint64_t utils::file_hash(const fs::path& file, bool& ok) {
+    std::ifstream in(file, std::ios::binary);
+    ok = bool(in);
+    std::vector<char> buffer(1 << 20);
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    uint64_t length = 0;
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        size_t got = in.gcount();
+        // pad the tail with zeros, the length is mixed in at the end
+        std::fill(buffer.begin() + got, buffer.begin() + ((got + 7) & ~size_t(7)), 0);
+        for (size_t i = 0; i < got; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, sizeof(word));
+            hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+            hash ^= hash >> 29;
         }
+        length += got;
     }
-    return std::vector<fs::path>(std::make_move_iterator(files_to_sweep.begin()),
-                                 std::make_move_iterator(files_to_sweep.end()));
+    if (in.bad())
+        ok = false;
+    hash ^= length;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 32);
 }
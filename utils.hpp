@@ -1,11 +1,33 @@
+#pragma once
+
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <string>
 #include <vector>
 
 namespace fs = std::filesystem;
 
 namespace utils {
+// false in `readable` if `dir` itself cannot be read
 std::vector<fs::path> find_all_files(
-    const fs::path& dir, std::function<bool(const std::string&)> pred);
+    const fs::path& dir, std::function<bool(const std::string&)> pred,
+    uint32_t num_scanners = 1, bool* readable = nullptr);
+
+/* walk `dir` recursively with `num_scanners` threads, each listing one
+directory at a time, and hand every regular file whose name satisfies
+`pred` to `on_file` as soon as it is found. `on_file` is called from any of
+the scanners. Unreadable directories are skipped; returns false if `dir`
+itself cannot be read. */
+bool scan_files(const fs::path& dir, std::function<bool(const std::string&)> pred,
+                uint32_t num_scanners, std::function<void(fs::path&&)> on_file);
+
+// parse a byte count such as "4096", "64K", "512M" or "2G"; throws
+// std::invalid_argument on anything else
+uint64_t parse_size(const std::string& text);
+
+// a 64-bit hash of the contents of `file`, to tell changed files apart; not
+// cryptographic. Sets `ok` to false if the file cannot be read
+uint64_t file_hash(const fs::path& file, bool& ok);
 
 }  // namespace utils
@@ -0,0 +1,35 @@
+#include "vocabulary.hpp"
+
+uint32_t wc::vocabulary::id(std::string_view word, uint64_t hash) {
+    uint32_t index = hash >> (64 - shard_bits);
+    shard& s = shards[index];
+    std::lock_guard<std::mutex> lock(s.mtx);
+    if (uint64_t known = s.ids.find(word, hash))
+        return known - 1;
+    uint32_t id = s.by_index.size() * num_shards + index;
+    s.ids.add(word, hash, uint64_t(id) + 1);
+    s.by_index.emplace_back(s.words.store(word), word.size());
+    return id;
+}
+
+void wc::vocabulary::decode(std::string_view key, std::string& out) const {
+    for (size_t i = 0; i * sizeof(uint32_t) < key.size(); i++) {
+        if (i != 0)
+            out.push_back(' ');
+        out.append(word(id_at(key, i)));
+    }
+}
+
+size_t wc::vocabulary::size() const {
+    size_t total = 0;
+    for (const shard& s : shards) total += s.by_index.size();
+    return total;
+}
+
+void wc::vocabulary::clear() {
+    for (shard& s : shards) {
+        s.ids.clear();
+        s.words.clear();
+        std::vector<std::string_view>().swap(s.by_index);
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "counter_table.hpp"
+#include "key_arena.hpp"
+
+namespace wc {
+/* n-gram keys in id form are the 32-bit ids of their words, packed back to
+back in native byte order. A key of n <= 2 words fits the eight bytes a
+counter_table keeps inline, longer keys are a small fixed array in the arena. */
+inline void append_id(std::string& key, uint32_t id) {
+    char bytes[sizeof(id)];
+    std::memcpy(bytes, &id, sizeof(id));
+    key.append(bytes, sizeof(id));
+}
+
+inline uint32_t id_at(std::string_view key, size_t index) {
+    uint32_t id;
+    std::memcpy(&id, key.data() + index * sizeof(id), sizeof(id));
+    return id;
+}
+
+// hash of a packed id key, far cheaper than hashing the joined words
+inline uint64_t hash_ids(std::string_view key) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ key.size();
+    for (size_t i = 0; i * sizeof(uint32_t) < key.size(); i++) {
+        h ^= id_at(key, i);
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+// hash_ids of the packed key of `K` ids, with the loop unrolled
+template <uint32_t K>
+inline uint64_t hash_ids(const uint32_t* ids) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ (K * sizeof(uint32_t));
+    for (uint32_t i = 0; i != K; i++) {
+        h ^= ids[i];
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* shared dictionary from folded word to 32-bit id, sharded by hash so that
+mappers assigning ids at the same time rarely meet on a lock. Ids are dense
+within a shard: id = index in shard * num_shards + shard. */
+class vocabulary {
+    // a word's shard is the top shard_bits of its hash
+    static constexpr uint32_t shard_bits = 6;
+    static constexpr uint32_t num_shards = 1u << shard_bits;
+
+    struct alignas(64) shard {
+        std::mutex mtx;
+        // the count of a word is its id + 1
+        counter_table ids;
+        key_arena words;
+        std::vector<std::string_view> by_index;
+    };
+    std::vector<shard> shards;
+
+   public:
+    vocabulary() : shards(num_shards) {}
+
+    // id of `word`, whose hash_key() is `hash`; new words get the next free id
+    uint32_t id(std::string_view word, uint64_t hash);
+    // the word behind `id`; only safe once no more ids are being assigned
+    std::string_view word(uint32_t id) const {
+        return shards[id % num_shards].by_index[id / num_shards];
+    }
+    // append the words of a packed id key to `out`, joined by a space
+    void decode(std::string_view key, std::string& out) const;
+    size_t size() const;
+    // forget every word, ids start over from 0; only while none are in use
+    void clear();
+};
+
+/* per-thread memo in front of the shared vocabulary, so a mapper only takes
+a shard lock the first time it meets a word */
+class word_cache {
+    vocabulary& vocab;
+    counter_table ids;
+
+   public:
+    explicit word_cache(vocabulary& vocab) : vocab(vocab) {}
+
+    uint32_t id(std::string_view word) {
+        uint64_t hash = hash_key(word);
+        if (uint64_t known = ids.find(word, hash))
+            return known - 1;
+        uint32_t id = vocab.id(word, hash);
+        ids.add(word, hash, uint64_t(id) + 1);
+        return id;
+    }
+    // forget the memo, as after vocabulary::clear()
+    void clear() { ids.clear(); }
+};
+}  // namespace wc